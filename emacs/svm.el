@@ -8,8 +8,8 @@
 ;;
 
 (setq svm-keywords
- '(("^\s*add\\|^\s*DB\\|^\s*DATA\\|^\s*sub\\|^\s*store\\|^\s*mul\\|^\s*ret\\|^\s*div\\|^\s*inc\\|^\s*dec\\|^\s*system\\|^\s*concat\\|^\s*string2int\\|^\s*int2string\\|^\s*cmp\\|^\s*load\\|^\s*print_int\\|^\s*print_str\\|^\s*push\\|^\s*pop\\|^\s*peek\\|^\s*poke\\|^\s*is_string\\|^\s*is_integer\\|^\s*memcpy\\|^\s*nop\\|^\s*exit" . font-lock-function-name-face)
-   ("^\s*goto\\|^\s*call\\|^\s*jmpnz\\|^\s*jmpz\\|^:[-_A-Za-z0-9]+" . font-lock-warning-face)
+ '(("^\s*add\\|^\s*DB\\|^\s*DATA\\|^\s*sub\\|^\s*store\\|^\s*mul\\|^\s*ret\\|^\s*div\\|^\s*mod\\|^\s*and\\|^\s*or\\|^\s*xor\\|^\s*shl\\|^\s*shr\\|^\s*sar\\|^\s*rol\\|^\s*ror\\|^\s*popcnt\\|^\s*clz\\|^\s*ctz\\|^\s*inc\\|^\s*dec\\|^\s*system\\|^\s*concat\\|^\s*string2int\\|^\s*int2string\\|^\s*cmp\\|^\s*load\\|^\s*print_int\\|^\s*print_str\\|^\s*push\\|^\s*pop\\|^\s*peek\\|^\s*poke\\|^\s*is_string\\|^\s*is_integer\\|^\s*memcpy\\|^\s*nop\\|^\s*exit" . font-lock-function-name-face)
+   ("^\s*goto\\|^\s*call\\|^\s*jmp[a-z]*\\|^\s*djnz\\|^\s*switch\\|^\s*table\\|^:[-_A-Za-z0-9]+" . font-lock-warning-face)
   )
 )
 
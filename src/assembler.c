@@ -0,0 +1,240 @@
+/**
+ * assembler.c - Command-line driver for the in-process assembler.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+#include "simple-vm-assembler.h"
+
+
+
+/**
+ * Show warnings on STDOUT, as the perl compiler does.
+ */
+void warning(char *msg)
+{
+    printf("%s\n", msg);
+}
+
+
+
+/**
+ * The custom opcodes given with `--extensions`, if any.
+ */
+svm_extension_t *extensions = NULL;
+
+
+
+/**
+ * Read the table of custom opcodes which `simple-vm --extension-table`
+ * writes, as the perl compiler does with `--extensions`.
+ */
+int read_extensions(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to read extensions %s\n", filename);
+        return 1;
+    }
+
+    char line[256];
+    unsigned int count = 0;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        char name[SVM_EXTENSION_NAME], operands[SVM_EXTENSION_OPERANDS + 1], effects[4];
+        unsigned int opcode;
+        char *p = line + strspn(line, " \t");
+
+        if ((*p == '#') || (*p == '\n') || (*p == '\0'))
+            continue;
+
+        _Bool valid = (sscanf(p, "%31s 0x%2x %8s %3s", name, &opcode, operands, effects) == 4);
+
+        /* the operands are '-' if there are none, and a string must be last */
+        if (valid && (strcmp(operands, "-") == 0))
+            operands[0] = '\0';
+        if (valid && ((strspn(operands, "rwm24s") != strlen(operands)) ||
+                      (strchr(operands, 's') && strchr(operands, 's')[1])))
+            valid = false;
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid extension in %s: %s", filename, line);
+            fclose(fp);
+            return 1;
+        }
+
+        svm_extension_t *tmp = realloc(extensions, (count + 2) * sizeof(svm_extension_t));
+        if (tmp)
+            extensions = tmp;
+
+        char *copy = tmp ? malloc(strlen(name) + strlen(operands) + 2) : NULL;
+        if (!copy)
+        {
+            fprintf(stderr, "Failed to allocate RAM for extensions\n");
+            fclose(fp);
+            return 1;
+        }
+
+        /* the name and operands share an allocation, which is never freed */
+        strcpy(copy, name);
+        strcpy(copy + strlen(name) + 1, operands);
+
+        extensions[count].name = copy;
+        extensions[count].opcode = opcode;
+        extensions[count].operands = copy + strlen(name) + 1;
+        extensions[count].effects = 0;
+        extensions[count].handler = NULL;
+        count++;
+        memset(&extensions[count], '\0', sizeof(svm_extension_t));
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+
+
+/**
+ * Compile the given source-file, writing the output to a file with
+ * the same name but a `.raw` suffix.
+ */
+int compile_file(const char *filename)
+{
+    struct stat sb;
+
+    if (stat(filename, &sb) != 0)
+    {
+        fprintf(stderr, "Failed to read source %s\n", filename);
+        return 1;
+    }
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to read source %s\n", filename);
+        return 1;
+    }
+
+    char *source = malloc(sb.st_size + 1);
+    if (!source)
+    {
+        fprintf(stderr, "Failed to allocate RAM for source %s\n", filename);
+        fclose(fp);
+        return 1;
+    }
+
+    size_t size = fread(source, 1, sb.st_size, fp);
+    fclose(fp);
+
+
+    /**
+     * Assemble.
+     */
+    svm_assembly_t out;
+    memset(&out, '\0', sizeof(out));
+    out.warning = &warning;
+    out.extensions = extensions;
+
+    if (!svm_assemble(source, size, &out))
+    {
+        fprintf(stderr, "%s: %s\n", filename, out.error);
+        free(source);
+        return 1;
+    }
+    free(source);
+
+
+    /**
+     * Output/compiled programs will have a .raw suffix.
+     */
+    char *output = malloc(strlen(filename) + 5);
+    if (!output)
+    {
+        svm_assembly_free(&out);
+        return 1;
+    }
+    strcpy(output, filename);
+
+    char *suffix = strrchr(output, '.');
+    if (suffix && suffix[1])
+        *suffix = '\0';
+    strcat(output, ".raw");
+
+
+    fp = fopen(output, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to write to %s\n", output);
+        free(output);
+        svm_assembly_free(&out);
+        return 1;
+    }
+
+    if (out.size && fwrite(out.code, 1, out.size, fp) != out.size)
+    {
+        fprintf(stderr, "Failed to write to %s\n", output);
+        fclose(fp);
+        free(output);
+        svm_assembly_free(&out);
+        return 1;
+    }
+
+    fclose(fp);
+    free(output);
+    svm_assembly_free(&out);
+    return 0;
+}
+
+
+
+/**
+ * Compile each file named on the command-line.
+ */
+int main(int argc, char **argv)
+{
+    int first = 1;
+
+    if ((argc > 1) && (strncmp(argv[1], "--extensions=", 13) == 0))
+    {
+        if (read_extensions(argv[1] + 13) != 0)
+            return 1;
+        first++;
+    }
+
+    if (argc <= first)
+    {
+        printf("Usage: %s [--extensions=file] input-file [input-file ..]\n", argv[0]);
+        return 0;
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+        if (compile_file(argv[i]) != 0)
+            return 1;
+    }
+
+    return 0;
+}
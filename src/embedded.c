@@ -1,5 +1,5 @@
 /**
- * embedded.c - Example embedded usage with custom opcode.
+ * embedded.c - Example embedded usage with custom opcode, and native functions.
  *
  * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
  *
@@ -23,6 +23,8 @@
 
 
 #include "simple-vm.h"
+#include "simple-vm-extension.h"
+#include "simple-vm-native.h"
 
 
 /**
@@ -42,6 +44,39 @@ unsigned char bytecode[] = {
     /* CUSTOM OPCODE - Which will call a handler in *this* file! */
     0xCD,
 
+    /* STORE "Steve" in register 02 */
+    0x30,
+    0x02,
+    0x05,
+    0x00,
+    'S', 't', 'e', 'v', 'e',
+
+    /* CALL_NATIVE 1 - the length of register 02, stored in register 03 */
+    0xD0,
+    0x01,
+    0x03,
+    0x02,
+
+    /* PRINT register 03 */
+    0x02,
+    0x03,
+
+    /* STORE 3, 4 & 5 in registers 04, 05 & 06 */
+    0x01, 0x04, 0x03, 0x00,
+    0x01, 0x05, 0x04, 0x00,
+    0x01, 0x06, 0x05, 0x00,
+
+    /* CALL_NATIVE_BATCH 2 - square each of registers 04 to 06, in place */
+    0xD1,
+    0x02,
+    0x04,
+    0x04,
+    0x03,
+
+    /* PRINT register 06 */
+    0x02,
+    0x06,
+
     /* EXIT */
     0x00,
 
@@ -51,13 +86,56 @@ unsigned char bytecode[] = {
 /**
  * The handler for the custom opcode
  */
-void op_custom(struct svm *svm)
+_Bool op_custom(svm_t * svm, const svm_operand_t * operands)
 {
+    (void) operands;
+
     printf("\nCustom Handling Here\n");
     printf("\tOur bytecode is %d bytes long\n", svm->size);
 
-    /* handle the next instruction */
-    svm->ip += 1;
+    /* the machine moves on to the next instruction */
+    return true;
+}
+
+
+/**
+ * The description of the custom opcode, which takes no operands and has
+ * no side effects.
+ */
+const svm_extension_t custom = { "custom", 0xCD, "", 0, op_custom };
+
+
+/**
+ * A native function, which returns the length of a string.
+ */
+_Bool native_length(svm_t * cpu, unsigned int calls, const svm_value_t * args,
+                    svm_value_t * results)
+{
+    (void) cpu;
+
+    for (unsigned int i = 0; i < calls; i++)
+        results[i].integer = args[i].length;
+
+    return true;
+}
+
+
+/**
+ * A native function, which returns the square of an integer.
+ *
+ * When called by CALL_NATIVE_BATCH it is given every integer at once.
+ */
+_Bool native_square(svm_t * cpu, unsigned int calls, const svm_value_t * args,
+                    svm_value_t * results)
+{
+    (void) cpu;
+
+    printf("\nSquaring %u integers\n", calls);
+
+    for (unsigned int i = 0; i < calls; i++)
+        results[i].integer = args[i].integer * args[i].integer;
+
+    return true;
 }
 
 
@@ -80,7 +158,19 @@ int run_vm()
     /**
      * Allow our our custom handler to be called via opcode 0xCD.
      */
-    cpu->opcodes[0xCD] = op_custom;
+    if (!svm_register_extension(cpu, &custom))
+    {
+        printf("Failed to register the custom opcode.\n");
+        svm_free(cpu);
+        return 1;
+    }
+
+    /**
+     * Register our native functions, the first taking a string and the
+     * second an integer, each returning an integer.
+     */
+    svm_register_native(cpu, 1, native_length, "s>i");
+    svm_register_native(cpu, 2, native_square, "i>i");
 
     /**
      * Run the bytecode.
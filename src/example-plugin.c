@@ -0,0 +1,98 @@
+/**
+ * example-plugin.c - A plugin which adds custom opcodes.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ * Build with:
+ *
+ *    cc -fPIC -shared -o example-plugin.so src/example-plugin.c
+ *
+ * Then load it, and generate the table the compiler needs, with:
+ *
+ *    ./simple-vm --plugin ./example-plugin.so --extension-table > ext.tbl
+ *    ./compiler --extensions=ext.tbl ./examples/plugin.in
+ *    ./simple-vm --plugin ./example-plugin.so ./examples/plugin.raw
+ *
+ */
+
+
+#include <string.h>
+
+
+#include "simple-vm-extension.h"
+
+
+
+/**
+ * rot13 #r: Rotate the letters of the string in the given register.
+ */
+static _Bool ext_rot13(svm_t * svm, const svm_operand_t * operands)
+{
+    unsigned int reg = operands[0].value;
+
+    if (!REGISTER_IS_STRING(svm, reg))
+    {
+        svm_default_error_handler(svm, "The register doesn't contain a string");
+        return false;
+    }
+
+    for (char *c = REGISTER_STRING(svm, reg); *c; c++)
+    {
+        if ((*c >= 'a') && (*c <= 'z'))
+            *c = 'a' + (*c - 'a' + 13) % 26;
+        else if ((*c >= 'A') && (*c <= 'Z'))
+            *c = 'A' + (*c - 'A' + 13) % 26;
+    }
+
+    return true;
+}
+
+
+/**
+ * startswith #r, "prefix": Set the Z flag if the string in the given
+ * register begins with the prefix.
+ */
+static _Bool ext_startswith(svm_t * svm, const svm_operand_t * operands)
+{
+    unsigned int reg = operands[0].value;
+
+    if (!REGISTER_IS_STRING(svm, reg))
+    {
+        svm_default_error_handler(svm, "The register doesn't contain a string");
+        return false;
+    }
+
+    const char *str = REGISTER_STRING(svm, reg);
+    svm->flags.z = (strlen(str) >= operands[1].length) &&
+        (memcmp(str, operands[1].string, operands[1].length) == 0);
+
+    return true;
+}
+
+
+/**
+ * The version of the descriptors below, which the machine checks.
+ */
+const unsigned int svm_extension_abi = SVM_EXTENSION_ABI;
+
+
+/**
+ * The custom opcodes this plugin adds.
+ */
+const svm_extension_t svm_extensions[] = {
+    {"rot13", 0xE0, "m", 0, ext_rot13},
+    {"startswith", 0xE1, "rs", SVM_EXTENSION_WRITES_FLAGS, ext_startswith},
+    {NULL, 0, NULL, 0, NULL}
+};
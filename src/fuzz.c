@@ -0,0 +1,195 @@
+/**
+ * fuzz.c - Persistent-mode fuzzing driver for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/shm.h>
+
+
+#include "simple-vm.h"
+
+
+/**
+ * The maximum number of instructions we'll execute for each input.
+ *
+ * This ensures that programs containing infinite loops terminate.
+ */
+#define FUZZ_MAX_INSTRUCTIONS 16384
+
+
+/**
+ * The single virtual machine instance which is reused for every input.
+ */
+static svm_t *cpu = NULL;
+
+
+/**
+ * Where the error-handler returns to, rather than terminating.
+ */
+static jmp_buf recover;
+
+
+/**
+ * Error-handler.
+ *
+ * Rather than calling `exit` we abandon the current input and unwind
+ * back to `fuzz_one`, leaving the machine ready for the next input.
+ */
+void fuzz_error(char *msg)
+{
+    if (getenv("DEBUG") != NULL)
+        fprintf(stderr, "ERROR running script - %s\n", msg);
+
+    longjmp(recover, 1);
+}
+
+
+/**
+ * Create the virtual machine, if we've not already done so.
+ */
+void fuzz_init()
+{
+    unsigned char exit_op[] = { 0x00 };
+
+    if (cpu)
+        return;
+
+    /**
+     * Never let the fuzzer run system().
+     */
+    setenv("FUZZ", "1", 1);
+
+    cpu = svm_new(exit_op, sizeof(exit_op));
+    if (!cpu)
+    {
+        fprintf(stderr, "Failed to create virtual machine instance.\n");
+        exit(1);
+    }
+
+    svm_set_error_handler(cpu, &fuzz_error);
+
+    /**
+     * If we're running beneath afl then record the edges the bytecode
+     * takes in its shared-memory map, otherwise in a private one.
+     */
+    char *shm = getenv("__AFL_SHM_ID");
+    unsigned char *map = NULL;
+
+    if (shm != NULL)
+    {
+        map = shmat(atoi(shm), NULL, 0);
+        if (map == (void *) -1)
+            map = NULL;
+    }
+    svm_coverage_enable(cpu, map);
+}
+
+
+/**
+ * Execute a single input, reusing our existing virtual machine.
+ */
+int fuzz_one(const unsigned char *data, size_t size)
+{
+    fuzz_init();
+
+    if (size > 0xFFFF)
+        size = 0xFFFF;
+
+    if (!svm_reset(cpu, (unsigned char *) data, size))
+        return 0;
+
+    if (setjmp(recover) == 0)
+        svm_run_N_instructions(cpu, FUZZ_MAX_INSTRUCTIONS);
+
+    return 0;
+}
+
+
+/**
+ * Entry-point for libFuzzer, if we're built with -fsanitize=fuzzer.
+ */
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size)
+{
+    return (fuzz_one(data, size));
+}
+
+
+#ifndef FUZZ_LIBFUZZER
+
+/**
+ * Driver for afl.
+ *
+ * When built via afl-clang-fast we run in persistent-mode, reading
+ * many inputs from STDIN within a single process.  Otherwise each
+ * named file is executed in turn, which is useful for reproducing
+ * crashes and measuring the coverage of a corpus.
+ */
+int main(int argc, char **argv)
+{
+    /**
+     * Object-files may only be loaded from aligned memory.
+     */
+    static unsigned char buf[0xFFFF] __attribute__ ((aligned(8)));
+
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+    __AFL_INIT();
+#endif
+
+#ifdef __AFL_LOOP
+    (void) argc;
+    (void) argv;
+
+    while (__AFL_LOOP(10000))
+    {
+        ssize_t len = read(0, buf, sizeof(buf));
+        if (len >= 0)
+            fuzz_one(buf, len);
+    }
+#else
+    if (argc < 2)
+    {
+        printf("Usage: %s input-file [input-file ..]\n", argv[0]);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            printf("Failed to open program-file %s\n", argv[i]);
+            continue;
+        }
+
+        size_t len = fread(buf, 1, sizeof(buf), fp);
+        fclose(fp);
+
+        fuzz_one(buf, len);
+    }
+
+    printf("%u edges covered by %d input(s)\n", svm_coverage_edges(cpu), argc - 1);
+#endif
+
+    return 0;
+}
+
+#endif                          /* FUZZ_LIBFUZZER */
@@ -20,11 +20,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 
 #include "simple-vm.h"
+#include "simple-vm-extension.h"
 
 
 
@@ -36,47 +39,142 @@ void error(char *msg)
 
 
 
-int run_file(const char *filename, int instructions)
+/**
+ * Read the whole of the given stream, which might be a pipe, returning
+ * the contents and their size.
+ */
+unsigned char *read_all(int fd, size_t * size)
 {
-    struct stat sb;
+    size_t max = 0xFFFF;
+    unsigned char *buf = malloc(max);
 
-    if (stat(filename, &sb) != 0)
+    *size = 0;
+
+    while (buf)
     {
-        printf("Failed to read file: %s\n", filename);
-        return 1;
+        if (*size == max)
+        {
+            unsigned char *bigger = realloc(buf, max * 2);
+            if (!bigger)
+                break;
+
+            buf = bigger;
+            max *= 2;
+        }
+
+        ssize_t got = read(fd, buf + *size, max - *size);
+        if (got == 0)
+            return buf;
+        if (got < 0)
+            break;
+
+        *size += got;
     }
 
-    int size = sb.st_size;
+    free(buf);
+    return NULL;
+}
+
+
 
-    FILE *fp = fopen(filename, "rb");
-    if (!fp)
+/**
+ * Load the given plugins into the machine, reporting any failure.
+ */
+int load_plugins(svm_t * cpu, const char **plugins, int count)
+{
+    for (int i = 0; i < count; i++)
     {
-        printf("Failed to open program-file %s\n", filename);
+        const char *problem;
+
+        if (!svm_load_extensions(cpu, plugins[i], &problem))
+        {
+            fprintf(stderr, "Failed to load plugin %s - %s\n", plugins[i], problem);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+
+/**
+ * Show the table of the custom opcodes the given plugins add, which the
+ * compiler and decompiler read with --extensions.
+ */
+int show_extensions(const char **plugins, int count)
+{
+    unsigned char code = 0;
+    svm_t *cpu = svm_new(&code, 1);
+
+    if (!cpu)
+    {
+        printf("Failed to create virtual machine instance.\n");
         return 1;
     }
 
-    unsigned char *code = malloc(size);
-    if (!code)
+    if (!load_plugins(cpu, plugins, count))
     {
-        printf("Failed to allocate RAM for program-file %s\n", filename);
-        fclose(fp);
+        svm_free(cpu);
         return 1;
     }
-    memset(code, '\0', size);
 
-    /**
-     * Abort on a short-read, or error.
-     */
-    size_t read = fread(code, 1, size, fp);
-    if ( read < 1 || ( read < (size_t)size ) )
+    printf("# name opcode operands effects\n");
+
+    for (int i = 0; cpu->extensions && (i < 256); i++)
     {
-        fprintf(stderr,"Failed to wholly read input file\n" );
-        fclose(fp);
+        if (cpu->extensions[i])
+        {
+            char line[128];
+            svm_extension_describe(cpu->extensions[i], line, sizeof(line));
+            printf("%s\n", line);
+        }
+    }
+
+    svm_free(cpu);
+    return 0;
+}
+
+
+
+int run_file(const char *filename, int instructions, const char *profile_out,
+             const char **plugins, int plugin_count)
+{
+    struct stat sb;
+    svm_t *cpu;
+
+    int fd = open(filename, O_RDONLY);
+    if ((fd < 0) || (fstat(fd, &sb) != 0))
+    {
+        printf("Failed to open program-file %s\n", filename);
         return 1;
     }
-    fclose(fp);
 
-    svm_t *cpu = svm_new(code, size);
+    if (S_ISREG(sb.st_mode))
+    {
+        /**
+         * Regular files are mapped, rather than read.
+         */
+        cpu = svm_new_from_fd(fd);
+    }
+    else
+    {
+        /**
+         * Pipes, and other streams, can't be mapped so we read them.
+         */
+        size_t size;
+        unsigned char *code = read_all(fd, &size);
+        if (!code || size < 1)
+        {
+            fprintf(stderr, "Failed to wholly read input file\n");
+            close(fd);
+            return 1;
+        }
+
+        cpu = svm_new(code, size);
+        free(code);
+    }
+    close(fd);
+
     if (!cpu)
     {
         printf("Failed to create virtual machine instance.\n");
@@ -88,6 +186,25 @@ int run_file(const char *filename, int instructions)
      */
     svm_set_error_handler(cpu, &error);
 
+    /**
+     * Install any custom opcodes.
+     */
+    if (!load_plugins(cpu, plugins, plugin_count))
+    {
+        svm_free(cpu);
+        return 1;
+    }
+
+    /**
+     * Record the execution profile, if we're to save it.
+     */
+    if (profile_out && !svm_profile_enable(cpu))
+    {
+        printf("Failed to allocate RAM for the profile.\n");
+        svm_free(cpu);
+        return 1;
+    }
+
 
     /**
      * Run the bytecode.
@@ -95,6 +212,13 @@ int run_file(const char *filename, int instructions)
     svm_run_N_instructions(cpu, instructions);
 
 
+    /**
+     * Save the profile?
+     */
+    if (profile_out && !svm_profile_write(cpu, profile_out))
+        fprintf(stderr, "Failed to write profile to %s\n", profile_out);
+
+
     /**
      * Dump?
      */
@@ -106,7 +230,6 @@ int run_file(const char *filename, int instructions)
      * Cleanup.
      */
     svm_free(cpu);
-    free(code);
     return 0;
 }
 
@@ -122,16 +245,40 @@ int run_file(const char *filename, int instructions)
 int main(int argc, char **argv)
 {
     int max_instructions = 0;
+    const char *profile_out = NULL;
+    const char *filename = NULL;
+    const char **plugins = calloc(argc, sizeof(char *));
+    int plugin_count = 0;
+    int table = 0;
+
+    if (!plugins)
+        return 1;
 
-    if (argc < 2)
+    for (int i = 1; i < argc; i++)
     {
-        printf("Usage: %s input-file\n", argv[0]);
-        return 0;
+        if ((strcmp(argv[i], "--profile-out") == 0) && (i + 1 < argc))
+            profile_out = argv[++i];
+        else if ((strcmp(argv[i], "--plugin") == 0) && (i + 1 < argc))
+            plugins[plugin_count++] = argv[++i];
+        else if (strcmp(argv[i], "--extension-table") == 0)
+            table = 1;
+        else if (!filename)
+            filename = argv[i];
+        else
+            max_instructions = atoi(argv[i]);
     }
 
-    if ( argc > 2 )
-        max_instructions = atoi(argv[2]);
+    int ret = 0;
+
+    if (table)
+        ret = show_extensions(plugins, plugin_count);
+    else if (!filename)
+        printf("Usage: %s [--plugin file.so]... [--profile-out file] input-file [max-instructions]\n"
+               "       %s [--plugin file.so]... --extension-table\n", argv[0], argv[0]);
+    else
+        ret = run_file(filename, max_instructions, profile_out, plugins, plugin_count);
 
-    return (run_file(argv[1], max_instructions));
+    free(plugins);
+    return ret;
 
 }
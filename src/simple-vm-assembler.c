@@ -0,0 +1,2229 @@
+/**
+ * simple-vm-assembler.c - In-process assembler for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+
+#include "simple-vm.h"
+#include "simple-vm-opcodes.h"
+#include "simple-vm-assembler.h"
+
+
+/**
+ *
+ * This is a C implementation of the perl `compiler` script, which allows
+ * host applications to assemble programs at runtime without spawning
+ * perl.
+ *
+ * The syntax accepted is identical, quirks and all, and the generated
+ * bytecode is byte-for-byte the same.  Each line of the source is tested
+ * against the same patterns, in the same order, as the perl script uses.
+ *
+ * As with the perl version labels are handled by emitting a placeholder
+ * address, and recording the location in a fixup-table.  Once the whole
+ * program has been processed the fixups are applied, so only a single
+ * pass over the source is required.
+ *
+ */
+
+
+
+/**
+ * A label, and the offset it refers to.
+ */
+typedef struct label {
+    char *name;
+    unsigned int offset;
+} label_t;
+
+
+/**
+ * A location in the output which must be updated with the address of
+ * the named label, once it is known.
+ */
+typedef struct fixup {
+    unsigned int offset;
+    char *label;
+    int line;
+} fixup_t;
+
+
+/**
+ * The state of the assembler, while it is running.
+ */
+typedef struct assembler {
+    /**
+     * The bytecode we've generated, and the space allocated for it.
+     */
+    unsigned char *code;
+    unsigned int size;
+    unsigned int allocated;
+
+    /**
+     * Labels we've seen, held in an open-addressing hash-table.
+     */
+    label_t *labels;
+    unsigned int label_count;
+    unsigned int label_slots;
+
+    /**
+     * Pending fixups.
+     */
+    fixup_t *fixups;
+    unsigned int fixup_count;
+    unsigned int fixup_slots;
+
+    /**
+     * The line we're processing, for diagnostics.
+     */
+    int line;
+
+    /**
+     * Where we report errors and warnings.
+     */
+    svm_assembly_t *out;
+    _Bool failed;
+} assembler_t;
+
+
+
+/**
+ * Record a fatal error.
+ */
+static void fail(assembler_t * a, const char *fmt, ...)
+{
+    va_list ap;
+    char msg[200];
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    if (!a->failed)
+        snprintf(a->out->error, sizeof(a->out->error), "line %d: %s", a->line, msg);
+
+    a->failed = true;
+}
+
+
+/**
+ * Report a non-fatal warning, if the caller is interested.
+ */
+static void warn(assembler_t * a, const char *fmt, ...)
+{
+    va_list ap;
+    char msg[512];
+
+    if (!a->out->warning)
+        return;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    (*a->out->warning) (msg);
+}
+
+
+/**
+ * Append a single byte to the output.
+ */
+static void emit(assembler_t * a, unsigned int byte)
+{
+    if (a->size >= a->allocated)
+    {
+        unsigned int allocated = a->allocated ? a->allocated * 2 : 4096;
+        unsigned char *tmp = realloc(a->code, allocated);
+
+        if (!tmp)
+        {
+            fail(a, "RAM allocation failure.");
+            return;
+        }
+        a->code = tmp;
+        a->allocated = allocated;
+    }
+
+    a->code[a->size++] = byte & 0xFF;
+}
+
+
+/**
+ * Append a register-number, which must fit in a byte.
+ */
+static void emit_reg(assembler_t * a, uint64_t reg)
+{
+    if (reg > 0xFF)
+        fail(a, "Register too large: %" PRIu64, reg);
+
+    emit(a, reg);
+}
+
+
+/**
+ * Append a two-byte value, low byte first.
+ */
+static void emit_addr(assembler_t * a, uint64_t val)
+{
+    if (val > 0xFFFF)
+        fail(a, "Int too large");
+
+    emit(a, val % 256);
+    emit(a, val / 256);
+}
+
+
+/**
+ * Append an instruction which takes a register and an immediate value,
+ * using the narrowest of the given 16, 32 and 64-bit opcodes which will
+ * hold the value.
+ */
+static void emit_immediate(assembler_t * a, const int opcodes[3], uint64_t reg,
+                           uint64_t val)
+{
+    int bytes = (val <= 0xFFFF) ? 2 : (val <= 0xFFFFFFFF) ? 4 : 8;
+
+    emit(a, opcodes[bytes == 2 ? 0 : bytes == 4 ? 1 : 2]);
+    emit_reg(a, reg);
+
+    for (int i = 0; i < bytes; i++)
+        emit(a, (val >> (8 * i)) & 0xFF);
+}
+
+
+/**
+ * Hash a label name.
+ */
+static unsigned int hash_label(const char *name)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*name)
+    {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * Find the slot a label occupies, or would occupy.
+ */
+static label_t *find_label(assembler_t * a, const char *name)
+{
+    unsigned int i = hash_label(name) & (a->label_slots - 1);
+
+    while (a->labels[i].name && strcmp(a->labels[i].name, name) != 0)
+        i = (i + 1) & (a->label_slots - 1);
+
+    return (&a->labels[i]);
+}
+
+
+/**
+ * Lookup the offset of a label, returning false if it isn't defined.
+ */
+static _Bool lookup_label(assembler_t * a, const char *name, unsigned int *offset)
+{
+    if (!a->label_slots)
+        return false;
+
+    label_t *l = find_label(a, name);
+    if (!l->name)
+        return false;
+
+    *offset = l->offset;
+    return true;
+}
+
+
+/**
+ * Define a label, replacing any previous definition.
+ */
+static void define_label(assembler_t * a, const char *name, unsigned int offset)
+{
+    /**
+     * Keep the table no more than half full.
+     */
+    if ((a->label_count + 1) * 2 > a->label_slots)
+    {
+        label_t *old = a->labels;
+        unsigned int old_slots = a->label_slots;
+
+        a->label_slots = old_slots ? old_slots * 2 : 64;
+        a->labels = calloc(a->label_slots, sizeof(label_t));
+        if (!a->labels)
+        {
+            a->labels = old;
+            a->label_slots = old_slots;
+            fail(a, "RAM allocation failure.");
+            return;
+        }
+
+        for (unsigned int i = 0; i < old_slots; i++)
+            if (old[i].name)
+                *find_label(a, old[i].name) = old[i];
+        free(old);
+    }
+
+    label_t *l = find_label(a, name);
+    if (!l->name)
+    {
+        l->name = strdup(name);
+        a->label_count++;
+    }
+    l->offset = offset;
+}
+
+
+/**
+ * Record that the two bytes before the current offset need to be
+ * replaced with the address of the given label.
+ */
+static void add_fixup(assembler_t * a, const char *label)
+{
+    if (a->fixup_count >= a->fixup_slots)
+    {
+        unsigned int slots = a->fixup_slots ? a->fixup_slots * 2 : 64;
+        fixup_t *tmp = realloc(a->fixups, slots * sizeof(fixup_t));
+
+        if (!tmp)
+        {
+            fail(a, "RAM allocation failure.");
+            return;
+        }
+        a->fixups = tmp;
+        a->fixup_slots = slots;
+    }
+
+    a->fixups[a->fixup_count].offset = a->size - 2;
+    a->fixups[a->fixup_count].label = strdup(label);
+    a->fixups[a->fixup_count].line = a->line;
+    a->fixup_count++;
+}
+
+
+
+/**
+ ** Helpers for matching the patterns the perl compiler uses.
+ **
+ ** Each helper takes a pointer to the current position in the line, and
+ ** only advances it if the match succeeds.
+ **/
+
+
+/**
+ * Perl's idea of whitespace - `\s`.
+ */
+static int is_space(char c)
+{
+    return (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v');
+}
+
+
+/**
+ * `\s*`
+ */
+static const char *skip_space(const char *p)
+{
+    while (is_space(*p))
+        p++;
+    return p;
+}
+
+
+/**
+ * `\s+`
+ */
+static _Bool space1(const char **p)
+{
+    if (!is_space(**p))
+        return false;
+
+    *p = skip_space(*p);
+    return true;
+}
+
+
+/**
+ * `\s?`
+ */
+static void space_opt(const char **p)
+{
+    if (is_space(**p))
+        *p += 1;
+}
+
+
+/**
+ * Match a literal string, optionally ignoring case.
+ */
+static _Bool literal(const char **p, const char *word, _Bool nocase)
+{
+    size_t len = strlen(word);
+
+    if ((nocase ? strncasecmp(*p, word, len) : strncmp(*p, word, len)) != 0)
+        return false;
+
+    *p += len;
+    return true;
+}
+
+
+/**
+ * Match a single character.
+ */
+static _Bool character(const char **p, char c)
+{
+    if (**p != c)
+        return false;
+
+    *p += 1;
+    return true;
+}
+
+
+/**
+ * `[0-9]+`
+ */
+static _Bool digits(const char **p, uint64_t *val)
+{
+    const char *s = *p;
+
+    if (!isdigit((unsigned char) *s))
+        return false;
+
+    *val = 0;
+    while (isdigit((unsigned char) *s))
+    {
+        unsigned int d = *s - '0';
+
+        /* saturate, rather than wrapping around */
+        if (*val > (UINT64_MAX - d) / 10)
+            *val = UINT64_MAX;
+        else
+            *val = (*val * 10) + d;
+        s++;
+    }
+
+    *p = s;
+    return true;
+}
+
+
+/**
+ * `#([0-9]+)`
+ */
+static _Bool reg(const char **p, uint64_t *val)
+{
+    const char *s = *p;
+
+    if (!character(&s, '#') || !digits(&s, val))
+        return false;
+
+    *p = s;
+    return true;
+}
+
+
+/**
+ * `([^\s]+)` - the result is copied to `buf`.
+ */
+static _Bool token(const char **p, char *buf, size_t len)
+{
+    const char *s = *p;
+
+    while (*s && !is_space(*s))
+        s++;
+
+    if (s == *p || (size_t) (s - *p) >= len)
+        return false;
+
+    memcpy(buf, *p, s - *p);
+    buf[s - *p] = '\0';
+    *p = s;
+    return true;
+}
+
+
+/**
+ * Is the given string entirely decimal digits - `^[0-9]+$`?
+ */
+static _Bool all_digits(const char *s)
+{
+    if (!*s)
+        return false;
+
+    while (*s)
+        if (!isdigit((unsigned char) *s++))
+            return false;
+    return true;
+}
+
+
+/**
+ * Convert a string to a number in the same way perl's `hex` does.
+ */
+static uint64_t perl_hex(const char *s)
+{
+    uint64_t val = 0;
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        s += 2;
+
+    while (isxdigit((unsigned char) *s) || *s == '_')
+    {
+        if (*s != '_')
+        {
+            if (val > (UINT64_MAX >> 4))
+                val = UINT64_MAX;
+            else
+                val = (val * 16) + (isdigit((unsigned char) *s) ? *s - '0'
+                                    : (tolower((unsigned char) *s) - 'a' + 10));
+        }
+        s++;
+    }
+    return val;
+}
+
+
+/**
+ * Convert a string to a number in the same way perl does when a string
+ * is used in a numeric context - leading digits are used, anything
+ * else is ignored.
+ */
+static uint64_t perl_num(const char *s)
+{
+    uint64_t val = 0;
+
+    s = skip_space(s);
+    if (*s == '+')
+        s++;
+
+    digits(&s, &val);
+    return val;
+}
+
+
+/**
+ * Would the given number, which might start with `0x`, be too large to
+ * fit in 64-bits?
+ *
+ * This counts the significant digits, as the perl compiler does.
+ */
+static _Bool too_large(const char *s)
+{
+    size_t count = 0;
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    {
+        for (s += 2; isxdigit((unsigned char) *s) || *s == '_'; s++)
+        {
+            if ((*s != '_') && (count || *s != '0'))
+                count++;
+        }
+        return (count > 16);
+    }
+
+    s = skip_space(s);
+    if (*s == '+')
+        s++;
+    while (*s == '0')
+        s++;
+
+    const char *start = s;
+    while (isdigit((unsigned char) *s))
+        s++;
+
+    count = s - start;
+    return ((count > 20) ||
+            ((count == 20) && (strncmp(start, "18446744073709551615", 20) > 0)));
+}
+
+
+/**
+ * Convert a string which might start with `0x` to a number.
+ */
+static uint64_t number(const char *s)
+{
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        return (perl_hex(s));
+    return (perl_num(s));
+}
+
+
+
+/**
+ * Append the address of the given destination, which is either an
+ * address or a label.
+ */
+static void emit_destination(assembler_t * a, const char *dest)
+{
+    /*
+     *  If the destination begins with 0x or is entirely numeric
+     * then it is an address - otherwise a label.
+     */
+    if ((dest[0] == '0' && dest[1] == 'x') || all_digits(dest))
+    {
+        emit_addr(a, number(dest));
+    } else
+    {
+        emit_addr(a, 0);
+        add_fixup(a, dest);
+    }
+}
+
+
+
+/**
+ ** The individual line handlers.
+ **
+ ** Each returns true if the line matched, in which case code has been
+ ** generated, and false otherwise.
+ **/
+
+
+/**
+ * `:label`
+ */
+static _Bool label_definition(assembler_t * a, const char *p)
+{
+    unsigned int offset;
+
+    p = skip_space(p);
+    if (!character(&p, ':'))
+        return false;
+
+    /* Ensure labels are unique. */
+    if (lookup_label(a, p, &offset) && offset)
+    {
+        warn(a, "WARNING: Label name '%s' defined multiple times!\n"
+             "         Picking first occurrence.\n"
+             "         This is probably your bug.", p);
+    }
+
+    /*
+     * If a label starts with "0x" or is entirely numeric it
+     * WILL be confused for an address.
+     */
+    if ((p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) || all_digits(p))
+    {
+        warn(a, "WARNING: Label named '%s' WILL be confused for an address\n"
+             "         Strongly consider changing this", p);
+    }
+
+    define_label(a, p, a->size);
+    return true;
+}
+
+
+/**
+ * A custom opcode, described by one of the extensions we were given,
+ * with its operands separated by commas.
+ */
+static _Bool extension(assembler_t * a, const char *p)
+{
+    const svm_extension_t *ext = NULL;
+
+    p = skip_space(p);
+    if (!a->out->extensions || !(*p >= 'a' && *p <= 'z'))
+        return false;
+
+    size_t len = strspn(p, "abcdefghijklmnopqrstuvwxyz0123456789_");
+    if (p[len] && !is_space(p[len]))
+        return false;
+
+    /* the last description of a name wins, as it does in perl */
+    for (const svm_extension_t * e = a->out->extensions; e->name; e++)
+    {
+        if ((strlen(e->name) == len) && (strncmp(e->name, p, len) == 0))
+            ext = e;
+    }
+    if (!ext)
+        return false;
+
+    p = skip_space(p + len);
+
+    emit(a, ext->opcode);
+
+    for (const char *type = ext->operands; *type; type++)
+    {
+        if (type != ext->operands)
+        {
+            p = skip_space(p);
+            if (!character(&p, ','))
+            {
+                fail(a, "Missing operand for %s", ext->name);
+                return true;
+            }
+            p = skip_space(p);
+        }
+
+        if (strchr("rwm", *type))
+        {
+            uint64_t r;
+
+            if (!reg(&p, &r))
+            {
+                fail(a, "Missing register for %s", ext->name);
+                return true;
+            }
+            emit_reg(a, r);
+        }
+        else if (*type == 's')
+        {
+            const char *end = character(&p, '"') ? strchr(p, '"') : NULL;
+            if (!end)
+            {
+                fail(a, "Missing string for %s", ext->name);
+                return true;
+            }
+
+            /* expand newlines, & etc, counting the length first */
+            size_t length = 0;
+            for (const char *c = p; c < end; c++, length++)
+            {
+                if (c[0] == '\\' && c + 1 < end && (c[1] == 'n' || c[1] == 't'))
+                    c++;
+            }
+            if (length > 0xFFFF)
+            {
+                fail(a, "String too long for %s", ext->name);
+                return true;
+            }
+
+            emit_addr(a, length);
+            while (p < end)
+            {
+                if (p[0] == '\\' && p + 1 < end && (p[1] == 'n' || p[1] == 't'))
+                {
+                    emit(a, (p[1] == 'n') ? '\n' : '\t');
+                    p += 2;
+                } else
+                    emit(a, (unsigned char) *p++);
+            }
+            p = end + 1;
+        }
+        else
+        {
+            const char *start = p;
+
+            if ((p[0] == '0') && (p[1] == 'x' || p[1] == 'X') &&
+                isxdigit((unsigned char) p[2]))
+            {
+                for (p += 2; isxdigit((unsigned char) *p); p++)
+                    ;
+            } else
+            {
+                uint64_t ignored;
+                if (!digits(&p, &ignored))
+                {
+                    fail(a, "Missing value for %s", ext->name);
+                    return true;
+                }
+            }
+
+            if (too_large(start))
+            {
+                fail(a, "Int too large");
+                return true;
+            }
+
+            uint64_t val = number(start);
+            if (val > ((*type == '2') ? 0xFFFF : 0xFFFFFFFF))
+            {
+                fail(a, "Value too large for %s: %" PRIu64, ext->name, val);
+                return true;
+            }
+
+            for (int i = 0; i < ((*type == '2') ? 2 : 4); i++)
+                emit(a, (val >> (8 * i)) & 0xFF);
+        }
+    }
+
+    if (*skip_space(p))
+        fail(a, "Unexpected operands for %s: %s", ext->name, p);
+    return true;
+}
+
+
+/**
+ * `store #reg, "string"`
+ */
+static _Bool string_store(assembler_t * a, const char *p)
+{
+    uint64_t r;
+
+    if (!space1(&p) || !literal(&p, "store", false) || !space1(&p) || !reg(&p, &r))
+        return false;
+
+    space_opt(&p);
+    if (!character(&p, ','))
+        return false;
+    space_opt(&p);
+    if (!character(&p, '"'))
+        return false;
+
+    const char *end = strchr(p, '"');
+    if (!end)
+        return false;
+
+    /*
+     * Expand newlines, & etc, into a temporary copy.
+     */
+    char *str = malloc(end - p + 1);
+    size_t len = 0;
+
+    if (!str)
+    {
+        fail(a, "RAM allocation failure.");
+        return true;
+    }
+
+    while (p < end)
+    {
+        if (p[0] == '\\' && p + 1 < end && (p[1] == 'n' || p[1] == 't'))
+        {
+            str[len++] = (p[1] == 'n') ? '\n' : '\t';
+            p += 2;
+        } else
+            str[len++] = *p++;
+    }
+
+    emit(a, STRING_STORE);
+    emit_reg(a, r);
+    emit_addr(a, len);
+
+    for (size_t i = 0; i < len; i++)
+        emit(a, (unsigned char) str[i]);
+
+    free(str);
+    return true;
+}
+
+
+/**
+ * `store #reg, #reg`
+ */
+static _Bool register_store(assembler_t * a, const char *p)
+{
+    uint64_t dst, src;
+
+    if (!space1(&p) || !literal(&p, "store", false) || !space1(&p) || !reg(&p, &dst))
+        return false;
+
+    space_opt(&p);
+    if (!character(&p, ','))
+        return false;
+    space_opt(&p);
+    if (!reg(&p, &src))
+        return false;
+
+    emit(a, STORE_REG);
+    emit_reg(a, dst);
+    emit_reg(a, src);
+    return true;
+}
+
+
+/**
+ * `store #reg, 1234` or `store #reg, label`
+ */
+static _Bool int_store(assembler_t * a, const char *p)
+{
+    uint64_t r;
+    char val[256];
+
+    if (!space1(&p) || !literal(&p, "store", false) || !space1(&p) || !reg(&p, &r))
+        return false;
+
+    space_opt(&p);
+    if (!character(&p, ','))
+        return false;
+    space_opt(&p);
+    if (!token(&p, val, sizeof(val)))
+        return false;
+
+    /*
+     *  If the value is entirely numeric, or starts with 0x
+     * then it is an integer.
+     */
+    if ((val[0] == '0' && val[1] == 'x') || all_digits(val))
+    {
+        static const int opcodes[3] = { INT_STORE, INT_STORE32, INT_STORE64 };
+
+        if (too_large(val))
+        {
+            fail(a, "Int too large");
+            return true;
+        }
+        emit_immediate(a, opcodes, r, number(val));
+    } else
+    {
+        /* Storing the address of a label. */
+        emit(a, INT_STORE);
+        emit_reg(a, r);
+        emit_addr(a, 0);
+        add_fixup(a, val);
+    }
+    return true;
+}
+
+
+/**
+ * Instructions which have no arguments - `exit`, `nop` and `ret`.
+ */
+static _Bool no_args(assembler_t * a, const char *p)
+{
+    if (space1(&p))
+    {
+        if (literal(&p, "exit", false))
+        {
+            emit(a, EXIT);
+            return true;
+        }
+        if (literal(&p, "nop", false))
+        {
+            emit(a, NOP);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Instructions which take a register as the remainder of the line,
+ * such as `print_int #1`.
+ */
+static _Bool rest_register(assembler_t * a, const char *p, const char *name, int opcode)
+{
+    p = skip_space(p);
+    if (!literal(&p, name, false))
+        return false;
+
+    space_opt(&p);
+    if (!character(&p, '#'))
+        return false;
+
+    emit(a, opcode);
+    emit_reg(a, perl_num(p));
+    return true;
+}
+
+
+/**
+ * `goto`, `jmp`, `jmpz`, `jmpnz` and `call`.
+ */
+static _Bool jump(assembler_t * a, const char *p)
+{
+    static const struct {
+        const char *name;
+        int opcode;
+    } types[] = {
+        { "goto", JUMP_TO },
+        { "jmp", JUMP_TO },
+        { "jmpz", JUMP_Z },
+        { "jmpnz", JUMP_NZ },
+        { "jmpc", JUMP_C },
+        { "jmpnc", JUMP_NC },
+        { "jmps", JUMP_S },
+        { "jmpns", JUMP_NS },
+        { "jmpo", JUMP_O },
+        { "jmpno", JUMP_NO },
+        { "jmplt", JUMP_LT },
+        { "jmpge", JUMP_GE },
+        { "jmple", JUMP_LE },
+        { "jmpgt", JUMP_GT },
+        { "jmpbe", JUMP_BE },
+        { "jmpa", JUMP_A },
+        { "call", STACK_CALL },
+    };
+    char dest[256];
+
+    p = skip_space(p);
+
+    for (unsigned int i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        const char *s = p;
+
+        if (!literal(&s, types[i].name, false) || !space1(&s))
+            continue;
+
+        if (!token(&s, dest, sizeof(dest)))
+            return false;
+
+        emit(a, types[i].opcode);
+        emit_destination(a, dest);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * `jmp<condition> #reg, #reg, dest` and `jmp<condition> #reg, value, dest`.
+ */
+static _Bool compare_jump(assembler_t * a, const char *p)
+{
+    static const char *conditions[COND_MAX] = {
+        "z", "nz", "c", "nc", "s", "ns", "o", "no", "lt", "ge", "le", "gt", "be", "a"
+    };
+    uint64_t r;
+    char with[256];
+    char dest[256];
+
+    p = skip_space(p);
+    if (!literal(&p, "jmp", false))
+        return false;
+
+    for (unsigned int i = 0; i < COND_MAX; i++)
+    {
+        const char *s = p;
+
+        if (!literal(&s, conditions[i], false) || !space1(&s) || !reg(&s, &r))
+            continue;
+
+        s = skip_space(s);
+        if (!character(&s, ','))
+            return false;
+        s = skip_space(s);
+
+        /* `([^\s,]+)` */
+        size_t len = 0;
+        while (s[len] && !is_space(s[len]) && s[len] != ',')
+            len++;
+        if (len == 0 || len >= sizeof(with))
+            return false;
+        memcpy(with, s, len);
+        with[len] = '\0';
+        s += len;
+
+        s = skip_space(s);
+        if (!character(&s, ','))
+            return false;
+        s = skip_space(s);
+        if (!token(&s, dest, sizeof(dest)))
+            return false;
+
+        if (with[0] == '#' && all_digits(with + 1))
+        {
+            emit(a, CMP_JUMP);
+            emit_reg(a, r);
+            emit_reg(a, number(with + 1));
+            emit(a, i);
+        } else
+        {
+            if (too_large(with))
+            {
+                fail(a, "Int too large");
+                return true;
+            }
+
+            /*
+             *  Values which don't fit in 16-bits need a separate compare.
+             */
+            uint64_t val = number(with);
+            if (val <= 0xFFFF)
+            {
+                emit(a, CMP_IMMEDIATE_JUMP);
+                emit_reg(a, r);
+                emit_addr(a, val);
+                emit(a, i);
+            } else
+            {
+                static const int opcodes[3] =
+                    { CMP_IMMEDIATE, CMP_IMMEDIATE32, CMP_IMMEDIATE64 };
+
+                emit_immediate(a, opcodes, r, val);
+                emit(a, JUMP_Z + i);
+            }
+        }
+        emit_destination(a, dest);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Instructions which take a register and a destination - `djnz #reg, dest`
+ * and `switch #reg, table`.
+ */
+static _Bool register_destination(assembler_t * a, const char *p, const char *name,
+                                  int opcode)
+{
+    uint64_t r;
+    char dest[256];
+
+    p = skip_space(p);
+    if (!literal(&p, name, false) || !space1(&p) || !reg(&p, &r))
+        return false;
+
+    p = skip_space(p);
+    if (!character(&p, ','))
+        return false;
+    p = skip_space(p);
+    if (!token(&p, dest, sizeof(dest)))
+        return false;
+
+    emit(a, opcode);
+    emit_reg(a, r);
+    emit_destination(a, dest);
+    return true;
+}
+
+
+/**
+ * `goto #reg`, `jmp #reg`, and `call #reg`.
+ */
+static _Bool register_jump(assembler_t * a, const char *p)
+{
+    static const struct {
+        const char *name;
+        int opcode;
+    } types[] = {
+        { "goto", JUMP_REG },
+        { "jmp", JUMP_REG },
+        { "call", CALL_REG },
+    };
+    uint64_t r;
+
+    p = skip_space(p);
+
+    for (unsigned int i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        const char *s = p;
+
+        if (!literal(&s, types[i].name, false) || !space1(&s) || !reg(&s, &r))
+            continue;
+
+        emit(a, types[i].opcode);
+        emit_reg(a, r);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Three-register operations - `add #1, #2, #3`, etc.
+ */
+static _Bool three_registers(assembler_t * a, const char *p)
+{
+    static const struct {
+        const char *name;
+        int opcode;
+    } maths[] = {
+        { "add", ADD },
+        { "and", AND },
+        { "sub", SUB },
+        { "mul", MUL },
+        { "div", DIV },
+        { "mod", MOD },
+        { "or", OR },
+        { "xor", XOR },
+        { "shl", SHL },
+        { "shr", SHR },
+        { "sar", SAR },
+        { "rol", ROL },
+        { "ror", ROR },
+        { "concat", STRING_CONCAT },
+    };
+    uint64_t dst, src1, src2;
+
+    p = skip_space(p);
+
+    for (unsigned int i = 0; i < sizeof(maths) / sizeof(maths[0]); i++)
+    {
+        const char *s = p;
+
+        if (!literal(&s, maths[i].name, false) || !space1(&s))
+            continue;
+
+        if (!reg(&s, &dst))
+            return false;
+        s = skip_space(s);
+        if (!character(&s, ','))
+            return false;
+        s = skip_space(s);
+        if (!reg(&s, &src1))
+            return false;
+        s = skip_space(s);
+        if (!character(&s, ','))
+            return false;
+        s = skip_space(s);
+        if (!reg(&s, &src2))
+            return false;
+
+        emit(a, maths[i].opcode);
+        emit_reg(a, dst);
+        emit_reg(a, src1);
+        emit_reg(a, src2);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Instructions which take a single register - `inc #1`, etc.
+ */
+static _Bool one_register(assembler_t * a, const char *p, const char *name, int opcode)
+{
+    uint64_t r;
+
+    p = skip_space(p);
+    if (!literal(&p, name, false) || !space1(&p) || !reg(&p, &r))
+        return false;
+
+    emit(a, opcode);
+    emit_reg(a, r);
+    return true;
+}
+
+
+/**
+ * Instructions which take two registers - `peek #1, #2`, etc.
+ */
+static _Bool two_registers(assembler_t * a, const char *p, const char *name,
+                           int opcode, _Bool nocase)
+{
+    uint64_t r1, r2;
+
+    p = skip_space(p);
+    if (!literal(&p, name, nocase) || !space1(&p) || !reg(&p, &r1))
+        return false;
+
+    p = skip_space(p);
+    if (!character(&p, ','))
+        return false;
+    p = skip_space(p);
+    if (!reg(&p, &r2))
+        return false;
+
+    emit(a, opcode);
+    emit_reg(a, r1);
+    emit_reg(a, r2);
+    return true;
+}
+
+
+/**
+ * `cmp #reg, "string"`
+ */
+static _Bool cmp_string(assembler_t * a, const char *p)
+{
+    uint64_t r;
+
+    if (!space1(&p) || !literal(&p, "cmp", false) || !space1(&p) || !reg(&p, &r))
+        return false;
+
+    space_opt(&p);
+    if (!character(&p, ','))
+        return false;
+    space_opt(&p);
+    if (!character(&p, '"'))
+        return false;
+
+    const char *end = strchr(p, '"');
+    if (!end)
+        return false;
+
+    emit(a, CMP_STRING);
+    emit_reg(a, r);
+    emit_addr(a, end - p);
+
+    while (p < end)
+        emit(a, (unsigned char) *p++);
+
+    return true;
+}
+
+
+/**
+ * `cmp #reg, 1234`
+ */
+static _Bool cmp_immediate(assembler_t * a, const char *p)
+{
+    uint64_t r;
+    char val[256];
+
+    p = skip_space(p);
+    if (!literal(&p, "cmp", true) || !space1(&p) || !reg(&p, &r))
+        return false;
+
+    p = skip_space(p);
+    if (!character(&p, ','))
+        return false;
+    p = skip_space(p);
+    if (!token(&p, val, sizeof(val)))
+        return false;
+
+    static const int opcodes[3] = { CMP_IMMEDIATE, CMP_IMMEDIATE32, CMP_IMMEDIATE64 };
+
+    if (too_large(val))
+    {
+        fail(a, "Int too large");
+        return true;
+    }
+    emit_immediate(a, opcodes, r, number(val));
+    return true;
+}
+
+
+/**
+ * `is_string #reg` and `is_integer #reg`.
+ */
+static _Bool is_type(assembler_t * a, const char *p)
+{
+    return (one_register(a, p, "is_string", IS_STRING) ||
+            one_register(a, p, "is_integer", IS_INTEGER));
+}
+
+
+/**
+ * Instructions which take three registers, other than the maths - the
+ * bulk memory operations such as `memcpy #dst, #src, #len`, and
+ * `map_set #map, #key, #value`, & etc.
+ */
+static _Bool register_triple(assembler_t * a, const char *p, const char *name, int opcode)
+{
+    uint64_t r1, r2, r3;
+
+    p = skip_space(p);
+    if (!literal(&p, name, false) || !space1(&p) || !reg(&p, &r1))
+        return false;
+
+    p = skip_space(p);
+    if (!character(&p, ','))
+        return false;
+    p = skip_space(p);
+    if (!reg(&p, &r2))
+        return false;
+    p = skip_space(p);
+    if (!character(&p, ','))
+        return false;
+    p = skip_space(p);
+    if (!reg(&p, &r3))
+        return false;
+
+    emit(a, opcode);
+    emit_reg(a, r1);
+    emit_reg(a, r2);
+    emit_reg(a, r3);
+    return true;
+}
+
+
+/**
+ * The address of a load or store - the text between the brackets, such
+ * as `#1`, `#1 + 8`, `#1 + #2 * 4`, or `#1 + #2 * 4 - 2`.
+ *
+ * The base, index, and mode bytes, and the displacement, are appended.
+ * When there is no index register the base register is repeated in its
+ * place, as the perl compiler does.
+ */
+static void emit_address(assembler_t * a, const char *text)
+{
+    const char *p = skip_space(text);
+    uint64_t base, index, val = 0;
+    _Bool has_index = false;
+    char scale = '1', sign = '+';
+
+    if (!reg(&p, &base))
+        goto invalid;
+
+    /* `+ #index`, optionally followed by `* scale` */
+    const char *s = skip_space(p);
+    if (character(&s, '+') && (s = skip_space(s), reg(&s, &index)))
+    {
+        has_index = true;
+        p = s;
+
+        s = skip_space(p);
+        if (character(&s, '*') && (s = skip_space(s), isdigit((unsigned char) *s)))
+        {
+            const char *start = s;
+            digits(&s, &val);
+            if ((s - start != 1) || !strchr("1248", *start))
+            {
+                fail(a, "Invalid scale: %.*s", (int) (s - start), start);
+                return;
+            }
+            scale = *start;
+            p = s;
+        }
+    }
+
+    /* `+ displacement`, or `- displacement` */
+    val = 0;
+    s = skip_space(p);
+    if (*s == '+' || *s == '-')
+    {
+        const char *t = skip_space(s + 1);
+        const char *start = t;
+
+        if (t[0] == '0' && (t[1] == 'x' || t[1] == 'X') && isxdigit((unsigned char) t[2]))
+        {
+            for (t += 2; isxdigit((unsigned char) *t); t++)
+                ;
+            val = perl_hex(start);
+        } else if (!digits(&t, &val))
+            goto invalid;
+
+        sign = *s;
+        p = t;
+    }
+
+    if (*skip_space(p))
+        goto invalid;
+
+    if ((val > 32768) || ((val == 32768) && (sign == '+')))
+    {
+        fail(a, "Displacement too large: %c%" PRIu64, sign, val);
+        return;
+    }
+
+    uint64_t disp = (sign == '-') ? (0x10000 - val) & 0xFFFF : val;
+    int shift = (scale == '1') ? 0 : (scale == '2') ? 1 : (scale == '4') ? 2 : 3;
+
+    emit_reg(a, base);
+    emit_reg(a, has_index ? index : base);
+    emit(a, has_index ? (ADDRESS_INDEX | shift) : 0);
+    emit_addr(a, disp);
+    return;
+
+  invalid:
+    fail(a, "Invalid address: [%s]", text);
+}
+
+
+/**
+ * `load32 #reg, [address]` and `store32 [address], #reg`, and likewise
+ * for 8, 16, and 64-bit values.
+ */
+static _Bool memory_access(assembler_t * a, const char *p)
+{
+    static const struct {
+        const char *name;
+        int load;
+        int store;
+    } widths[] = {
+        { "8", LOAD8, STORE8 },
+        { "16", LOAD16, STORE16 },
+        { "32", LOAD32, STORE32 },
+        { "64", LOAD64, STORE64 },
+    };
+    char text[256];
+    uint64_t r;
+
+    p = skip_space(p);
+    _Bool load = literal(&p, "load", false);
+    if (!load && !literal(&p, "store", false))
+        return false;
+
+    for (unsigned int i = 0; i < sizeof(widths) / sizeof(widths[0]); i++)
+    {
+        const char *s = p;
+
+        if (!literal(&s, widths[i].name, false) || !space1(&s))
+            continue;
+
+        if (load)
+        {
+            if (!reg(&s, &r))
+                return false;
+            s = skip_space(s);
+            if (!character(&s, ','))
+                return false;
+            s = skip_space(s);
+        }
+
+        const char *end;
+        if (!character(&s, '[') || !(end = strchr(s, ']')) ||
+            ((size_t) (end - s) >= sizeof(text)))
+            return false;
+
+        memcpy(text, s, end - s);
+        text[end - s] = '\0';
+        s = end + 1;
+
+        if (!load)
+        {
+            s = skip_space(s);
+            if (!character(&s, ','))
+                return false;
+            s = skip_space(s);
+            if (!reg(&s, &r))
+                return false;
+        }
+
+        emit(a, load ? widths[i].load : widths[i].store);
+        emit_reg(a, r);
+        emit_address(a, text);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * The array operations - `vadd32 #dst, #a, #b, #count`, `vsum8 #result,
+ * #a, #count`, `vdot16 #result, #a, #b, #count`, and `vscan32 #dst, #a,
+ * #count`.
+ */
+static _Bool vector(assembler_t * a, const char *p)
+{
+    static const struct {
+        const char *name;
+        int opcode;
+        int operation;
+        int registers;
+    } ops[] = {
+        { "vadd", VECTOR_MAP, VECTOR_ADD, 4 },
+        { "vsub", VECTOR_MAP, VECTOR_SUB, 4 },
+        { "vmul", VECTOR_MAP, VECTOR_MUL, 4 },
+        { "vand", VECTOR_MAP, VECTOR_AND, 4 },
+        { "vor", VECTOR_MAP, VECTOR_OR, 4 },
+        { "vxor", VECTOR_MAP, VECTOR_XOR, 4 },
+        { "vsum", VECTOR_REDUCE, VECTOR_SUM, 3 },
+        { "vmin", VECTOR_REDUCE, VECTOR_MIN, 3 },
+        { "vmax", VECTOR_REDUCE, VECTOR_MAX, 3 },
+        { "vdot", VECTOR_DOT, 0, 4 },
+        { "vscan", VECTOR_SCAN, 0, 3 },
+    };
+    static const struct {
+        const char *name;
+        int width;
+    } widths[] = {
+        { "8", VECTOR_8 },
+        { "16", VECTOR_16 },
+        { "32", VECTOR_32 },
+    };
+    uint64_t r[4];
+
+    p = skip_space(p);
+
+    for (unsigned int i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        for (unsigned int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+        {
+            const char *s = p;
+
+            if (!literal(&s, ops[i].name, false) || !literal(&s, widths[w].name, false) ||
+                !space1(&s))
+                continue;
+
+            for (int n = 0; n < ops[i].registers; n++)
+            {
+                if (n > 0)
+                {
+                    s = skip_space(s);
+                    if (!character(&s, ','))
+                        return false;
+                    s = skip_space(s);
+                }
+                if (!reg(&s, &r[n]))
+                    return false;
+            }
+
+            emit(a, ops[i].opcode);
+            emit(a, (ops[i].operation << 2) | widths[w].width);
+            for (int n = 0; n < ops[i].registers; n++)
+                emit_reg(a, r[n]);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Sorting and searching arrays - `sort32 #array, #count`, and `bsearch32
+ * #result, #array, #count, #key`.
+ *
+ * A leading "r" means the array is in descending order, and "kv" that
+ * each element is followed by a value.
+ */
+static _Bool vector_order(assembler_t * a, const char *p)
+{
+    static const char *widths[] = { "8", "16", "32" };
+    uint64_t r[4];
+
+    p = skip_space(p);
+
+    int order = literal(&p, "r", false) ? VECTOR_DESCENDING : 0;
+
+    _Bool search = literal(&p, "bsearch", false);
+    if (!search && !literal(&p, "sort", false))
+        return false;
+
+    if (literal(&p, "kv", false))
+        order |= VECTOR_PAIRS;
+
+    for (unsigned int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    {
+        const char *s = p;
+
+        if (!literal(&s, widths[w], false) || !space1(&s))
+            continue;
+
+        int registers = search ? 4 : 2;
+        for (int n = 0; n < registers; n++)
+        {
+            if (n > 0)
+            {
+                s = skip_space(s);
+                if (!character(&s, ','))
+                    return false;
+                s = skip_space(s);
+            }
+            if (!reg(&s, &r[n]))
+                return false;
+        }
+
+        emit(a, search ? VECTOR_SEARCH : VECTOR_SORT);
+        emit(a, (order << 2) | w);
+        for (int n = 0; n < registers; n++)
+            emit_reg(a, r[n]);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Hashing - `crc32c #result, #address, #length` for a chunk of memory,
+ * or `crc32c #result, #string` for a string register, and likewise for
+ * `xxh64` and `adler32`.
+ */
+static _Bool hashing(assembler_t * a, const char *p)
+{
+    static const struct {
+        const char *name;
+        int algorithm;
+    } hashes[] = {
+        { "crc32c", HASH_CRC32C },
+        { "xxh64", HASH_XXH64 },
+        { "adler32", HASH_ADLER32 },
+    };
+    uint64_t r1, r2, r3;
+
+    p = skip_space(p);
+
+    for (unsigned int i = 0; i < sizeof(hashes) / sizeof(hashes[0]); i++)
+    {
+        const char *s = p;
+
+        if (!literal(&s, hashes[i].name, false) || !space1(&s))
+            continue;
+
+        if (!reg(&s, &r1))
+            return false;
+        s = skip_space(s);
+        if (!character(&s, ','))
+            return false;
+        s = skip_space(s);
+        if (!reg(&s, &r2))
+            return false;
+
+        /*
+         *  A third register means the operand is a chunk of memory.
+         */
+        s = skip_space(s);
+        _Bool memory = character(&s, ',');
+        if (memory)
+        {
+            s = skip_space(s);
+            memory = reg(&s, &r3);
+        }
+
+        emit(a, memory ? HASH_MEMORY : HASH_STRING);
+        emit(a, hashes[i].algorithm);
+        emit_reg(a, r1);
+        emit_reg(a, r2);
+        if (memory)
+            emit_reg(a, r3);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * `match #reg, "pattern"` or `match #reg, #pattern`, either of which may
+ * be followed by the first of the registers to store captures in.
+ */
+static _Bool match(assembler_t * a, const char *p)
+{
+    uint64_t r, pattern = 0, first = 0;
+    const char *start = NULL, *end = NULL;
+
+    p = skip_space(p);
+    if (!literal(&p, "match", false) || !space1(&p) || !reg(&p, &r))
+        return false;
+
+    p = skip_space(p);
+    if (!character(&p, ','))
+        return false;
+    p = skip_space(p);
+
+    if (character(&p, '"'))
+    {
+        start = p;
+        end = strchr(p, '"');
+        if (!end)
+            return false;
+        p = end + 1;
+    }
+    else if (!reg(&p, &pattern))
+        return false;
+
+    /*
+     *  A further register receives the offsets of the match.
+     */
+    p = skip_space(p);
+    _Bool captures = character(&p, ',');
+    if (captures)
+    {
+        p = skip_space(p);
+        captures = reg(&p, &first);
+    }
+    if (!captures)
+        first = 0;
+
+    emit(a, start ? MATCH : MATCH_REG);
+    emit_reg(a, r);
+    if (!start)
+        emit_reg(a, pattern);
+    emit_reg(a, first);
+    emit(a, captures);
+
+    if (start)
+    {
+        emit_addr(a, end - start);
+        while (start < end)
+            emit(a, (unsigned char) *start++);
+    }
+    return true;
+}
+
+
+/**
+ * `call_native id, #result, #first` and `call_native_batch id, #result,
+ * #first, calls`.
+ */
+static _Bool call_native(assembler_t * a, const char *p)
+{
+    uint64_t id, result, first, calls = 0;
+
+    p = skip_space(p);
+    if (!literal(&p, "call_native", false))
+        return false;
+
+    _Bool batch = literal(&p, "_batch", false);
+
+    if (!space1(&p) || !digits(&p, &id))
+        return false;
+
+    p = skip_space(p);
+    if (!character(&p, ','))
+        return false;
+    p = skip_space(p);
+    if (!reg(&p, &result))
+        return false;
+
+    p = skip_space(p);
+    if (!character(&p, ','))
+        return false;
+    p = skip_space(p);
+    if (!reg(&p, &first))
+        return false;
+
+    /* the count of calls is optional, as far as matching goes */
+    const char *s = skip_space(p);
+    _Bool counted = character(&s, ',') && (s = skip_space(s), digits(&s, &calls));
+
+    if (id > 255)
+    {
+        fail(a, "Native function too large: %" PRIu64, id);
+        return true;
+    }
+    if (result > 255 || first > 255)
+    {
+        fail(a, "Register too large: %" PRIu64, (result > 255) ? result : first);
+        return true;
+    }
+
+    if (!batch)
+    {
+        emit(a, CALL_NATIVE);
+        emit(a, id);
+        emit(a, result);
+        emit(a, first);
+        return true;
+    }
+
+    if (!counted)
+    {
+        fail(a, "Missing count of calls");
+        return true;
+    }
+    if (calls > 255)
+    {
+        fail(a, "Too many calls: %" PRIu64, calls);
+        return true;
+    }
+
+    emit(a, CALL_NATIVE_BATCH);
+    emit(a, id);
+    emit(a, result);
+    emit(a, first);
+    emit(a, calls);
+    return true;
+}
+
+
+/**
+ * `enter 4` and `leave`.
+ */
+static _Bool frame(assembler_t * a, const char *p)
+{
+    uint64_t count;
+
+    p = skip_space(p);
+    if (literal(&p, "leave", false))
+    {
+        emit(a, STACK_LEAVE);
+        return true;
+    }
+
+    if (!literal(&p, "enter", false) || !space1(&p))
+        return false;
+
+    const char *start = p;
+    if (!digits(&p, &count))
+        return false;
+
+    if (count > 0xFFFF)
+    {
+        fail(a, "Too many locals: %.*s", (int) (p - start), start);
+        return true;
+    }
+
+    emit(a, STACK_ENTER);
+    emit_addr(a, count);
+    return true;
+}
+
+
+/**
+ * Read the offset of a local variable, `-?[0-9]+`, which must fit in a
+ * signed 16-bit value.
+ */
+static _Bool local_offset(assembler_t * a, const char **p, uint64_t *offset)
+{
+    const char *start = *p;
+    _Bool negative = character(p, '-');
+
+    if (!digits(p, offset))
+        return false;
+
+    if ((*offset > 32768) || ((*offset == 32768) && !negative))
+    {
+        fail(a, "Local offset out of range: %.*s", (int) (*p - start), start);
+        *offset = 0;
+    }
+
+    if (negative)
+        *offset = (0x10000 - *offset) & 0xFFFF;
+    return true;
+}
+
+
+/**
+ * `local_get #reg, offset` and `local_set offset, #reg`.
+ */
+static _Bool local(assembler_t * a, const char *p)
+{
+    uint64_t r, offset;
+
+    p = skip_space(p);
+    if (literal(&p, "local_get", false))
+    {
+        if (!space1(&p) || !reg(&p, &r))
+            return false;
+
+        p = skip_space(p);
+        if (!character(&p, ','))
+            return false;
+        p = skip_space(p);
+        if (!local_offset(a, &p, &offset))
+            return false;
+
+        emit(a, LOCAL_GET);
+    }
+    else if (literal(&p, "local_set", false))
+    {
+        if (!space1(&p) || !local_offset(a, &p, &offset))
+            return false;
+
+        p = skip_space(p);
+        if (!character(&p, ','))
+            return false;
+        p = skip_space(p);
+        if (!reg(&p, &r))
+            return false;
+
+        emit(a, LOCAL_SET);
+    }
+    else
+        return false;
+
+    emit_reg(a, r);
+    emit_addr(a, offset);
+    return true;
+}
+
+
+/**
+ * `ret`
+ */
+static _Bool ret(assembler_t * a, const char *p)
+{
+    p = skip_space(p);
+    if (!literal(&p, "ret", false))
+        return false;
+
+    emit(a, STACK_RET);
+    return true;
+}
+
+
+/**
+ * `table label, label, 0x1234` - a jump table for `switch`, which is a
+ * count of the entries followed by the address of each.
+ */
+static _Bool table(assembler_t * a, const char *p)
+{
+    char dest[256];
+
+    p = skip_space(p);
+    if (!literal(&p, "table", false) || !space1(&p))
+        return false;
+
+    /*
+     *  The count comes first, so we need two passes over the entries.
+     */
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const char *s = p;
+        unsigned int count = 0;
+
+        while (*s)
+        {
+            const char *end = strchr(s, ',');
+            if (!end)
+                end = s + strlen(s);
+
+            /* strip leading/trailing space */
+            const char *start = skip_space(s);
+            const char *last = end;
+            while (last > start && is_space(last[-1]))
+                last--;
+
+            if (last > start)
+            {
+                if (pass == 1)
+                {
+                    size_t len = last - start;
+                    if (len >= sizeof(dest))
+                        len = sizeof(dest) - 1;
+
+                    memcpy(dest, start, len);
+                    dest[len] = '\0';
+                    emit_destination(a, dest);
+                }
+                count++;
+            }
+
+            s = *end ? end + 1 : end;
+        }
+
+        if (pass == 0)
+            emit_addr(a, count);
+    }
+    return true;
+}
+
+
+/**
+ * `db 1, 2, 0x03` or `data ..`
+ */
+static _Bool data(assembler_t * a, const char *p)
+{
+    char db[256];
+
+    p = skip_space(p);
+    if (!(literal(&p, "db", true) || literal(&p, "data", true)) || !space1(&p))
+        return false;
+
+    /*
+     *  Split each byte
+     */
+    while (*p)
+    {
+        const char *end = strchr(p, ',');
+        if (!end)
+            end = p + strlen(p);
+
+        /* strip leading/trailing space */
+        const char *start = skip_space(p);
+        const char *last = end;
+        while (last > start && is_space(last[-1]))
+            last--;
+
+        if (last > start)
+        {
+            size_t len = last - start;
+            if (len >= sizeof(db))
+                len = sizeof(db) - 1;
+
+            memcpy(db, start, len);
+            db[len] = '\0';
+
+            uint64_t val = number(db);
+
+            /* ensure the byte is within range. */
+            if (val > 255)
+            {
+                fail(a, "Data too large for a byte: %s", db);
+                return true;
+            }
+            emit(a, val);
+        }
+
+        p = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+
+/**
+ * Assemble a single line of source.
+ *
+ * The order of the tests matches the order used by the perl compiler,
+ * which matters because some of the patterns overlap.
+ */
+static void assemble_line(assembler_t * a, const char *line)
+{
+    const char *p = skip_space(line);
+
+    /*
+     *  Except comments / empty lines.
+     */
+    if (!*line || *p == '#')
+        return;
+
+    if (label_definition(a, line) ||
+        extension(a, line) ||
+        string_store(a, line) ||
+        register_store(a, line) ||
+        int_store(a, line) ||
+        no_args(a, line) ||
+        rest_register(a, line, "print_int", INT_PRINT) ||
+        rest_register(a, line, "print_str", STRING_PRINT) ||
+        rest_register(a, line, "system", STRING_SYSTEM) ||
+        register_jump(a, line) ||
+        register_destination(a, line, "switch", JUMP_TABLE) ||
+        compare_jump(a, line) ||
+        register_destination(a, line, "djnz", DEC_JUMP_NZ) ||
+        jump(a, line) ||
+        three_registers(a, line) ||
+        two_registers(a, line, "popcnt", POPCNT, false) ||
+        two_registers(a, line, "clz", CLZ, false) ||
+        two_registers(a, line, "ctz", CTZ, false) ||
+        one_register(a, line, "dec", DEC) ||
+        one_register(a, line, "inc", INC) ||
+        one_register(a, line, "int2string", INT_TOSTRING) ||
+        one_register(a, line, "random", INT_RANDOM) ||
+        one_register(a, line, "string2int", STRING_TOINT) ||
+        two_registers(a, line, "cmp", CMP_REG, true) ||
+        cmp_string(a, line) ||
+        cmp_immediate(a, line) ||
+        is_type(a, line) ||
+        two_registers(a, line, "peek", PEEK, false) ||
+        two_registers(a, line, "poke", POKE, false) ||
+        register_triple(a, line, "memcpy", MEMCPY) ||
+        register_triple(a, line, "memset", MEMSET) ||
+        register_triple(a, line, "memcmp", MEMCMP) ||
+        register_triple(a, line, "memchr", MEMCHR) ||
+        memory_access(a, line) ||
+        one_register(a, line, "bank", BANK) ||
+        vector(a, line) ||
+        vector_order(a, line) ||
+        hashing(a, line) ||
+        register_triple(a, line, "map_set", MAP_SET) ||
+        register_triple(a, line, "map_get", MAP_GET) ||
+        two_registers(a, line, "map_delete", MAP_DELETE, false) ||
+        two_registers(a, line, "map_contains", MAP_CONTAINS, false) ||
+        two_registers(a, line, "map_count", MAP_COUNT, false) ||
+        one_register(a, line, "map_new", MAP_NEW) ||
+        one_register(a, line, "map_free", MAP_FREE) ||
+        match(a, line) ||
+        call_native(a, line) ||
+        frame(a, line) ||
+        local(a, line) ||
+        one_register(a, line, "push", STACK_PUSH) ||
+        one_register(a, line, "pop", STACK_POP) ||
+        ret(a, line) ||
+        table(a, line) ||
+        data(a, line))
+        return;
+
+    warn(a, "WARNING UNKNOWN LINE: %s", line);
+}
+
+
+/**
+ * Apply the fixups we've recorded, now that all labels are known.
+ */
+static void apply_fixups(assembler_t * a)
+{
+    for (unsigned int i = 0; i < a->fixup_count && !a->failed; i++)
+    {
+        unsigned int target;
+
+        a->line = a->fixups[i].line;
+
+        if (!lookup_label(a, a->fixups[i].label, &target))
+        {
+            fail(a, "No target for label '%s' - Label not defined!", a->fixups[i].label);
+            return;
+        }
+        if (target > 0xFFFF)
+        {
+            fail(a, "Label '%s' is outside the address-space", a->fixups[i].label);
+            return;
+        }
+
+        a->code[a->fixups[i].offset] = target % 256;
+        a->code[a->fixups[i].offset + 1] = target / 256;
+    }
+}
+
+
+/**
+ * Assemble the given source into bytecode.
+ */
+_Bool svm_assemble(const char *source, unsigned int len, svm_assembly_t * out)
+{
+    assembler_t a;
+    char *line = NULL;
+    size_t line_size = 0;
+
+    if (!out)
+        return false;
+
+    out->code = NULL;
+    out->size = 0;
+    out->error[0] = '\0';
+
+    memset(&a, '\0', sizeof(a));
+    a.out = out;
+
+    /*
+     *  Process each line of the input.
+     */
+    unsigned int pos = 0;
+    while (pos < len && !a.failed)
+    {
+        const char *nl = memchr(source + pos, '\n', len - pos);
+        unsigned int end = nl ? (unsigned int) (nl - source) : len;
+        size_t length = end - pos;
+
+        if (length + 1 > line_size)
+        {
+            line_size = length + 1;
+            char *tmp = realloc(line, line_size);
+            if (!tmp)
+            {
+                fail(&a, "RAM allocation failure.");
+                break;
+            }
+            line = tmp;
+        }
+
+        memcpy(line, source + pos, length);
+        line[length] = '\0';
+
+        a.line++;
+        assemble_line(&a, line);
+
+        pos = end + 1;
+    }
+
+    if (!a.failed && a.size < 1)
+        warn(&a, "WARNING: Didn't generate any code");
+
+    if (!a.failed)
+        apply_fixups(&a);
+
+    /*
+     * Cleanup.
+     */
+    free(line);
+    for (unsigned int i = 0; i < a.label_slots; i++)
+        free(a.labels[i].name);
+    free(a.labels);
+    for (unsigned int i = 0; i < a.fixup_count; i++)
+        free(a.fixups[i].label);
+    free(a.fixups);
+
+    if (a.failed)
+    {
+        free(a.code);
+        return false;
+    }
+
+    out->code = a.code;
+    out->size = a.size;
+    return true;
+}
+
+
+/**
+ * Free the bytecode we generated.
+ */
+void svm_assembly_free(svm_assembly_t * out)
+{
+    if (!out)
+        return;
+
+    free(out->code);
+    out->code = NULL;
+    out->size = 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * simple-vm-assembler.h - Public header-file for the in-process assembler.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#ifndef SIMPLE_VM_ASSEMBLER_H
+#define SIMPLE_VM_ASSEMBLER_H 1
+
+
+#include "simple-vm.h"
+#include "simple-vm-extension.h"
+
+
+/**
+ * The result of assembling a program.
+ *
+ * The caller should zero this structure before use, and may set the
+ * `warning` member to receive non-fatal diagnostics, such as unknown
+ * lines, which the perl compiler would print.
+ *
+ * Once assembled the bytecode is available via `code` and `size`, and
+ * should be released with `svm_assembly_free`.  If assembly fails then
+ * `error` contains a description of the problem.
+ */
+typedef struct svm_assembly {
+    /**
+     * The generated bytecode, and the length of same.
+     */
+    unsigned char *code;
+    unsigned int size;
+
+    /**
+     * A description of the first fatal error encountered, if any.
+     */
+    char error[256];
+
+    /**
+     * Optional handler for warnings.
+     */
+    void (*warning) (char *msg);
+
+    /**
+     * Optional custom opcodes, ended by an entry with a NULL name, which
+     * are recognised before the built-in instructions.  Their handlers
+     * aren't used, so may be NULL.
+     */
+    const struct svm_extension *extensions;
+
+} svm_assembly_t;
+
+
+/**
+ * Assemble the given source, which uses the same syntax as the
+ * `compiler` script, into bytecode.
+ *
+ * Returns true on success.
+ */
+_Bool svm_assemble(const char *source, unsigned int len, svm_assembly_t * out);
+
+
+/**
+ * Free the bytecode generated by `svm_assemble`.
+ */
+void svm_assembly_free(svm_assembly_t * out);
+
+
+#endif                          /* SIMPLE_VM_ASSEMBLER_H */
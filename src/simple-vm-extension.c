@@ -0,0 +1,185 @@
+/**
+ * simple-vm-extension.c - Describing, and loading, custom opcodes.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "simple-vm-extension.h"
+#include "simple-vm-object.h"
+#include "simple-vm-opcodes.h"
+
+
+
+/**
+ * Is the given extension well-formed?
+ */
+_Bool svm_extension_valid(const svm_extension_t * ext)
+{
+    if (!ext || !ext->name || !ext->operands || !ext->handler)
+        return false;
+
+    size_t len = strlen(ext->name);
+    if ((len == 0) || (len >= SVM_EXTENSION_NAME) || (ext->name[0] < 'a') ||
+        (ext->name[0] > 'z'))
+        return false;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = ext->name[i];
+        if (!((c >= 'a') && (c <= 'z')) && !((c >= '0') && (c <= '9')) && (c != '_'))
+            return false;
+    }
+
+    len = strlen(ext->operands);
+    if (len > SVM_EXTENSION_OPERANDS)
+        return false;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!strchr("rwm24s", ext->operands[i]))
+            return false;
+
+        /* an inline string has no fixed length, so it must come last */
+        if ((ext->operands[i] == 's') && (i != len - 1))
+            return false;
+    }
+
+    return ((ext->effects & ~(SVM_EXTENSION_READS_FLAGS | SVM_EXTENSION_WRITES_FLAGS |
+                              SVM_EXTENSION_OPAQUE)) == 0);
+}
+
+
+/**
+ * May the given extension be installed?  It must be valid, and not
+ * replace a built-in opcode - or a handler an embedder installed itself.
+ *
+ * The first byte of the object-file magic is reserved too, as that is
+ * how object-files are told apart from raw programs.
+ */
+static _Bool can_register(svm_t * cpup, const svm_extension_t * ext)
+{
+    if (!svm_extension_valid(ext) ||
+        (ext->opcode == (unsigned char) SVM_OBJECT_MAGIC[0]))
+        return false;
+
+    opcode_implementation *current = cpup->opcodes[ext->opcode];
+    return ((current == op_unknown) || (current == op_extension));
+}
+
+
+/**
+ * Install the given extension.
+ */
+_Bool svm_register_extension(svm_t * cpup, const svm_extension_t * ext)
+{
+    if (!can_register(cpup, ext))
+        return false;
+
+    /* the table is only allocated once something is registered */
+    if (!cpup->extensions)
+    {
+        cpup->extensions = calloc(256, sizeof(svm_extension_t *));
+        if (!cpup->extensions)
+            return false;
+    }
+
+    cpup->extensions[ext->opcode] = ext;
+    cpup->opcodes[ext->opcode] = op_extension;
+    return true;
+}
+
+
+/**
+ * Load the extensions a plugin describes, and install them.
+ */
+_Bool svm_load_extensions(svm_t * cpup, const char *path, const char **error)
+{
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+    {
+        *error = dlerror();
+        return false;
+    }
+
+    const unsigned int *abi = dlsym(handle, "svm_extension_abi");
+    const svm_extension_t *table = dlsym(handle, "svm_extensions");
+
+    if (!abi || !table)
+        *error = "The plugin doesn't describe any extensions";
+    else if (*abi != SVM_EXTENSION_ABI)
+        *error = "The plugin was built for a different version";
+    else
+        *error = NULL;
+
+    /*
+     * Check every extension before installing any, so that a failure
+     * leaves the machine as it was.
+     */
+    _Bool seen[256] = { false };
+
+    for (unsigned int i = 0; !*error && table[i].name; i++)
+    {
+        if (!can_register(cpup, &table[i]))
+            *error = "The plugin has an invalid extension, or one which uses a built-in opcode";
+        else if (seen[table[i].opcode])
+            *error = "The plugin has two extensions with the same opcode";
+
+        seen[table[i].opcode] = true;
+    }
+
+    if (*error)
+    {
+        dlclose(handle);
+        return false;
+    }
+
+    for (unsigned int i = 0; table[i].name; i++)
+    {
+        if (!svm_register_extension(cpup, &table[i]))
+        {
+            *error = "RAM allocation failure.";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Describe an extension as a line of the table the compiler reads.
+ */
+void svm_extension_describe(const svm_extension_t * ext, char *buffer, size_t size)
+{
+    char effects[4] = "";
+
+    if (ext->effects & SVM_EXTENSION_READS_FLAGS)
+        strcat(effects, "r");
+    if (ext->effects & SVM_EXTENSION_WRITES_FLAGS)
+        strcat(effects, "w");
+    if (ext->effects & SVM_EXTENSION_OPAQUE)
+        strcat(effects, "x");
+
+    snprintf(buffer, size, "%s 0x%02X %s %s", ext->name, ext->opcode,
+             ext->operands[0] ? ext->operands : "-", effects[0] ? effects : "-");
+}
@@ -0,0 +1,148 @@
+/**
+ * simple-vm-extension.h - Describing, and loading, custom opcodes.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#ifndef SIMPLE_VM_EXTENSION_H
+#define SIMPLE_VM_EXTENSION_H 1
+
+
+#include "simple-vm.h"
+
+
+/**
+ * The version of the layout of `svm_extension_t`, which a plugin must
+ * export as `svm_extension_abi`.
+ */
+#define SVM_EXTENSION_ABI 1
+
+
+/**
+ * The largest number of operands an extension may take, and the longest
+ * name it may have.
+ */
+#define SVM_EXTENSION_OPERANDS 8
+#define SVM_EXTENSION_NAME 32
+
+
+/**
+ * The side effects of an extension, beyond writing the registers its
+ * operands name, which the compiler's optimiser must respect.
+ */
+#define SVM_EXTENSION_READS_FLAGS  1    /* depends upon the flags */
+#define SVM_EXTENSION_WRITES_FLAGS 2    /* sets the flags */
+#define SVM_EXTENSION_OPAQUE       4    /* touches anything else - other
+                                         * registers, RAM, or the stack */
+
+
+/**
+ * An operand, decoded from the instruction.
+ *
+ * Registers, and immediate values, are given in `value`.  An inline
+ * string is given by `string` and `length`, and points into the
+ * machine's RAM - it isn't terminated, and must not be modified or kept.
+ */
+typedef struct svm_operand {
+    uint64_t value;
+    const char *string;
+    unsigned int length;
+} svm_operand_t;
+
+
+/**
+ * The signature of the handler of an extension.
+ *
+ * The machine decodes the operands before calling it, and moves past
+ * the instruction afterwards, unless it returns false - having invoked
+ * the error-handler, or changed the instruction-pointer itself.
+ */
+typedef _Bool svm_extension_fn(svm_t * cpup, const svm_operand_t * operands);
+
+
+/**
+ * The description of a custom opcode.
+ *
+ * The operands are given as a string, with one character for each:
+ *
+ *    r    A register which is read.
+ *    w    A register which is written.
+ *    m    A register which is read, and modified.
+ *    2    A 16-bit immediate value.
+ *    4    A 32-bit immediate value.
+ *    s    An inline string, which must be the last operand.
+ *
+ * Each register takes a byte, and immediate values are stored low byte
+ * first; an inline string is a 16-bit length followed by its bytes.  The
+ * effects are a combination of the SVM_EXTENSION_ flags above.
+ */
+typedef struct svm_extension {
+    const char *name;
+    unsigned char opcode;
+    const char *operands;
+    unsigned int effects;
+    svm_extension_fn *handler;
+} svm_extension_t;
+
+
+/**
+ * Is the given extension well-formed?
+ *
+ * The name must be lower-case letters, digits, and underscores, starting
+ * with a letter, and the operands as described above.
+ */
+_Bool svm_extension_valid(const svm_extension_t * ext);
+
+
+/**
+ * Install the given extension, which must remain valid for the life of
+ * the machine, replacing any installed with the same opcode before.
+ *
+ * Returns false if it isn't valid, or its opcode is a built-in one - or
+ * 0x53, the first byte of the object-file magic.
+ */
+_Bool svm_register_extension(svm_t * cpup, const svm_extension_t * ext);
+
+
+/**
+ * Load the extensions a plugin describes, and install them.
+ *
+ * A plugin is a shared object which exports `svm_extension_abi`, set to
+ * SVM_EXTENSION_ABI, and an array `svm_extensions` ended by an entry
+ * with a NULL name.  It stays loaded, as the machine refers to it.
+ *
+ * Returns false, with a description of the problem in `error`, if the
+ * plugin can't be loaded or any of its extensions can't be installed -
+ * in which case none of them are.
+ */
+_Bool svm_load_extensions(svm_t * cpup, const char *path, const char **error);
+
+
+/**
+ * Describe an extension as a line of the table which the compiler and
+ * decompiler read with `--extensions`:
+ *
+ *    name opcode operands effects
+ *
+ * The operands are as above, or '-' if there are none, and the effects
+ * are any of 'r', 'w', and 'x' - for the flags above, in order - or '-'
+ * if there are none.
+ */
+void svm_extension_describe(const svm_extension_t * ext, char *buffer, size_t size);
+
+
+#endif                          /* SIMPLE_VM_EXTENSION_H */
@@ -0,0 +1,263 @@
+/**
+ * simple-vm-hash.c - Checksums and hashes for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "simple-vm-hash.h"
+
+
+
+/**
+ * The SSE4.2 CRC32 instruction is compiled regardless of the flags the
+ * rest of the machine is built with, and only used if the CPU has it.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SVM_HASH_X86 1
+#endif
+
+
+
+/**
+ * Read little-endian values from memory.
+ */
+static uint32_t read32(const unsigned char *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) |
+        ((uint32_t) p[3] << 24);
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+    return (uint64_t) read32(p) | ((uint64_t) read32(p + 4) << 32);
+}
+
+static uint64_t rotl64(uint64_t val, int bits)
+{
+    return (val << bits) | (val >> (64 - bits));
+}
+
+
+
+/**
+ * The CRC32C polynomial, reversed.
+ */
+#define CRC32C_POLYNOMIAL 0x82F63B78
+
+
+/**
+ * Calculate the CRC32C a byte at a time, via a table built the first
+ * time it is needed.
+ */
+static uint32_t crc32c_table(uint32_t crc, const unsigned char *data, size_t length)
+{
+    static uint32_t table[256];
+    static _Bool ready = 0;
+
+    if (!ready)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t val = i;
+            for (int bit = 0; bit < 8; bit++)
+                val = (val >> 1) ^ ((val & 1) ? CRC32C_POLYNOMIAL : 0);
+            table[i] = val;
+        }
+        ready = 1;
+    }
+
+    for (size_t i = 0; i < length; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+
+
+#ifdef SVM_HASH_X86
+
+/**
+ * Calculate the CRC32C eight bytes at a time, via SSE4.2.
+ */
+static uint32_t __attribute__ ((target("sse4.2")))
+    crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length)
+{
+    uint64_t val = crc;
+
+    for (; length >= 8; data += 8, length -= 8)
+        val = __builtin_ia32_crc32di(val, read64(data));
+
+    crc = val;
+    for (; length > 0; data++, length--)
+        crc = __builtin_ia32_crc32qi(crc, *data);
+
+    return crc;
+}
+
+#endif                          /* SVM_HASH_X86 */
+
+
+uint32_t svm_hash_crc32c(uint32_t crc, const unsigned char *data, size_t length)
+{
+    static uint32_t (*implementation) (uint32_t, const unsigned char *, size_t) = NULL;
+
+    /**
+     * Choose the implementation the first time we're called.
+     */
+    if (!implementation)
+    {
+        const char *name = getenv("SVM_HASH");
+
+        implementation = crc32c_table;
+#ifdef SVM_HASH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2") && !(name && (strcmp(name, "scalar") == 0)))
+            implementation = crc32c_sse42;
+#else
+        (void) name;
+#endif
+    }
+
+    /**
+     * The CRC is inverted before and after, so that it may be continued.
+     */
+    return ~implementation(~crc, data, length);
+}
+
+
+
+/**
+ * The largest number of bytes which may be added to an Adler-32 checksum
+ * before its sums must be reduced, so that they can't overflow.
+ */
+#define ADLER32_MODULUS 65521
+#define ADLER32_BLOCK   5552
+
+
+uint32_t svm_hash_adler32(uint32_t adler, const unsigned char *data, size_t length)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+
+    while (length > 0)
+    {
+        size_t block = (length < ADLER32_BLOCK) ? length : ADLER32_BLOCK;
+
+        for (size_t i = 0; i < block; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+
+        a %= ADLER32_MODULUS;
+        b %= ADLER32_MODULUS;
+        data += block;
+        length -= block;
+    }
+
+    return (b << 16) | a;
+}
+
+
+
+/**
+ * The primes used by XXH64.
+ */
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return (acc * XXH_PRIME64_1) + XXH_PRIME64_4;
+}
+
+
+uint64_t svm_hash_xxh64(uint64_t seed, const unsigned char *data, size_t length)
+{
+    const unsigned char *end = data + length;
+    uint64_t hash;
+
+    if (length >= 32)
+    {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        for (; end - data >= 32; data += 32)
+        {
+            v1 = xxh64_round(v1, read64(data));
+            v2 = xxh64_round(v2, read64(data + 8));
+            v3 = xxh64_round(v3, read64(data + 16));
+            v4 = xxh64_round(v4, read64(data + 24));
+        }
+
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = xxh64_merge(hash, v1);
+        hash = xxh64_merge(hash, v2);
+        hash = xxh64_merge(hash, v3);
+        hash = xxh64_merge(hash, v4);
+    } else
+    {
+        hash = seed + XXH_PRIME64_5;
+    }
+
+    hash += length;
+
+    for (; end - data >= 8; data += 8)
+    {
+        hash ^= xxh64_round(0, read64(data));
+        hash = (rotl64(hash, 27) * XXH_PRIME64_1) + XXH_PRIME64_4;
+    }
+
+    if (end - data >= 4)
+    {
+        hash ^= read32(data) * XXH_PRIME64_1;
+        hash = (rotl64(hash, 23) * XXH_PRIME64_2) + XXH_PRIME64_3;
+        data += 4;
+    }
+
+    for (; data < end; data++)
+    {
+        hash ^= *data * XXH_PRIME64_5;
+        hash = rotl64(hash, 11) * XXH_PRIME64_1;
+    }
+
+    /* avalanche */
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
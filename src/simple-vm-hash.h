@@ -0,0 +1,64 @@
+/**
+ * simple-vm-hash.h - Checksums and hashes for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#ifndef SIMPLE_VM_HASH_H
+#define SIMPLE_VM_HASH_H 1
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ *
+ * These routines implement the hashing opcodes.  The checksums may be
+ * called repeatedly, passing the previous result back in, to checksum
+ * data which isn't contiguous - the result is the same as checksumming
+ * it all at once.
+ *
+ */
+
+
+/**
+ * Continue the CRC32C (Castagnoli) checksum `crc`, which is zero to
+ * begin with.
+ *
+ * The SSE4.2 CRC32 instruction is used if the CPU supports it, unless the
+ * environment variable SVM_HASH is set to "scalar".
+ */
+uint32_t svm_hash_crc32c(uint32_t crc, const unsigned char *data, size_t length);
+
+
+/**
+ * Continue the Adler-32 checksum `adler`, which is one to begin with.
+ */
+uint32_t svm_hash_adler32(uint32_t adler, const unsigned char *data, size_t length);
+
+
+/**
+ * Return the 64-bit XXH64 hash of the given memory, with the given seed.
+ *
+ * Unlike the checksums this can't be continued, so it must be given all
+ * of the data at once.
+ */
+uint64_t svm_hash_xxh64(uint64_t seed, const unsigned char *data, size_t length);
+
+
+#endif                          /* SIMPLE_VM_HASH_H */
@@ -0,0 +1,288 @@
+/**
+ * simple-vm-map.c - Hash-maps for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "simple-vm-map.h"
+#include "simple-vm-hash.h"
+
+
+
+/**
+ * The number of slots in a new map, which is always a power of two, and
+ * the largest number of them which may be used before it grows.
+ */
+#define MAP_INITIAL_SLOTS 8
+#define MAP_FULL(count, slots) (((count) * 4) > ((slots) * 3))
+
+
+/**
+ * A slot in the map.
+ */
+typedef struct map_entry {
+    uint64_t hash;
+    reg_t key;
+    reg_t value;
+    _Bool used;
+    unsigned char key_type;
+    unsigned char value_type;
+} map_entry_t;
+
+
+struct svm_map {
+    map_entry_t *entries;
+    unsigned int slots;
+    unsigned int count;
+};
+
+
+
+/**
+ * Hash a key, so that integer keys and string keys are spread across
+ * the map evenly.
+ */
+static uint64_t key_hash(int key_type, reg_t key)
+{
+    if (key_type == STRING)
+        return svm_hash_xxh64(0, (const unsigned char *) key.string, strlen(key.string));
+
+    uint64_t hash = key.integer;
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+
+/**
+ * Does the given slot hold the given key?
+ */
+static _Bool key_matches(const map_entry_t * entry, uint64_t hash, int key_type,
+                         reg_t key)
+{
+    if (!entry->used || (entry->hash != hash) || (entry->key_type != key_type))
+        return false;
+
+    if (key_type == STRING)
+        return (strcmp(entry->key.string, key.string) == 0);
+
+    return (entry->key.integer == key.integer);
+}
+
+
+/**
+ * Find the slot holding the given key, or the empty slot where it
+ * belongs.
+ */
+static unsigned int find_slot(svm_map_t * map, uint64_t hash, int key_type, reg_t key)
+{
+    unsigned int i = hash & (map->slots - 1);
+
+    while (map->entries[i].used && !key_matches(&map->entries[i], hash, key_type, key))
+        i = (i + 1) & (map->slots - 1);
+
+    return i;
+}
+
+
+/**
+ * Move every entry into a table with twice as many slots.
+ */
+static _Bool grow(svm_map_t * map)
+{
+    unsigned int slots = map->slots * 2;
+    map_entry_t *entries = calloc(slots, sizeof(map_entry_t));
+    if (!entries)
+        return false;
+
+    for (unsigned int i = 0; i < map->slots; i++)
+    {
+        if (!map->entries[i].used)
+            continue;
+
+        unsigned int j = map->entries[i].hash & (slots - 1);
+        while (entries[j].used)
+            j = (j + 1) & (slots - 1);
+
+        entries[j] = map->entries[i];
+    }
+
+    free(map->entries);
+    map->entries = entries;
+    map->slots = slots;
+    return true;
+}
+
+
+
+svm_map_t *svm_map_new(void)
+{
+    svm_map_t *map = malloc(sizeof(svm_map_t));
+    if (!map)
+        return NULL;
+
+    map->entries = calloc(MAP_INITIAL_SLOTS, sizeof(map_entry_t));
+    if (!map->entries)
+    {
+        free(map);
+        return NULL;
+    }
+
+    map->slots = MAP_INITIAL_SLOTS;
+    map->count = 0;
+    return map;
+}
+
+
+void svm_map_free(svm_map_t * map)
+{
+    if (!map)
+        return;
+
+    for (unsigned int i = 0; i < map->slots; i++)
+    {
+        map_entry_t *entry = &map->entries[i];
+
+        if (entry->used && (entry->key_type == STRING))
+            free(entry->key.string);
+        if (entry->used && (entry->value_type == STRING))
+            free(entry->value.string);
+    }
+
+    free(map->entries);
+    free(map);
+}
+
+
+_Bool svm_map_set(svm_map_t * map, int key_type, reg_t key, int value_type, reg_t value)
+{
+    uint64_t hash = key_hash(key_type, key);
+    unsigned int i = find_slot(map, hash, key_type, key);
+
+    /**
+     * Take our own copy of a string value before anything changes.
+     */
+    if ((value_type == STRING) && !(value.string = strdup(value.string)))
+        return false;
+
+    if (map->entries[i].used)
+    {
+        if (map->entries[i].value_type == STRING)
+            free(map->entries[i].value.string);
+
+        map->entries[i].value_type = value_type;
+        map->entries[i].value = value;
+        return true;
+    }
+
+    /**
+     * A new key, which might need more room.
+     */
+    if ((key_type == STRING) && !(key.string = strdup(key.string)))
+        goto failed;
+
+    if (MAP_FULL(map->count + 1, map->slots))
+    {
+        if (!grow(map))
+            goto failed;
+        i = find_slot(map, hash, key_type, key);
+    }
+
+    map->entries[i].used = true;
+    map->entries[i].hash = hash;
+    map->entries[i].key_type = key_type;
+    map->entries[i].key = key;
+    map->entries[i].value_type = value_type;
+    map->entries[i].value = value;
+    map->count += 1;
+    return true;
+
+  failed:
+    if (key_type == STRING)
+        free(key.string);
+    if (value_type == STRING)
+        free(value.string);
+    return false;
+}
+
+
+_Bool svm_map_get(svm_map_t * map, int key_type, reg_t key, int *value_type,
+                  reg_t * value)
+{
+    unsigned int i = find_slot(map, key_hash(key_type, key), key_type, key);
+
+    if (!map->entries[i].used)
+        return false;
+
+    *value_type = map->entries[i].value_type;
+    *value = map->entries[i].value;
+    return true;
+}
+
+
+/**
+ * Deleting shifts the entries which follow the removed one back, where
+ * they may be, rather than leaving a marker in its slot - so lookups
+ * never have to step over deleted entries.
+ */
+_Bool svm_map_delete(svm_map_t * map, int key_type, reg_t key)
+{
+    unsigned int mask = map->slots - 1;
+    unsigned int i = find_slot(map, key_hash(key_type, key), key_type, key);
+
+    if (!map->entries[i].used)
+        return false;
+
+    if (map->entries[i].key_type == STRING)
+        free(map->entries[i].key.string);
+    if (map->entries[i].value_type == STRING)
+        free(map->entries[i].value.string);
+
+    for (unsigned int j = (i + 1) & mask; map->entries[j].used; j = (j + 1) & mask)
+    {
+        /**
+         * An entry may only move back if the gap isn't before the slot
+         * its hash selects, which would make it unreachable.
+         */
+        unsigned int home = map->entries[j].hash & mask;
+        _Bool stays = (i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j));
+
+        if (!stays)
+        {
+            map->entries[i] = map->entries[j];
+            i = j;
+        }
+    }
+
+    memset(&map->entries[i], '\0', sizeof(map_entry_t));
+    map->count -= 1;
+    return true;
+}
+
+
+unsigned int svm_map_count(svm_map_t * map)
+{
+    return map->count;
+}
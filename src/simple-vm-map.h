@@ -0,0 +1,87 @@
+/**
+ * simple-vm-map.h - Hash-maps for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#ifndef SIMPLE_VM_MAP_H
+#define SIMPLE_VM_MAP_H 1
+
+
+#include "simple-vm.h"
+
+
+/**
+ *
+ * A map associates keys with values, each of which is an integer or a
+ * string - the types of `enum register_types` - so that the contents of
+ * registers may be stored in them directly.  An integer key never equals
+ * a string key, even if the string holds the same number.
+ *
+ * The map uses open addressing with linear probing, and holds copies of
+ * the strings it is given.
+ *
+ */
+typedef struct svm_map svm_map_t;
+
+
+/**
+ * Allocate an empty map, returning NULL on failure.
+ */
+svm_map_t *svm_map_new(void);
+
+
+/**
+ * Free a map, along with every string it holds.
+ */
+void svm_map_free(svm_map_t * map);
+
+
+/**
+ * Associate the given key with the given value, replacing any value it
+ * had before.
+ *
+ * Returns false if memory could not be allocated, in which case the map
+ * is unchanged.
+ */
+_Bool svm_map_set(svm_map_t * map, int key_type, reg_t key, int value_type, reg_t value);
+
+
+/**
+ * Find the value associated with the given key.
+ *
+ * Returns false if there is none.  Otherwise the type and value are
+ * stored - a string value still belongs to the map.
+ */
+_Bool svm_map_get(svm_map_t * map, int key_type, reg_t key, int *value_type,
+                  reg_t * value);
+
+
+/**
+ * Remove the given key, and its value, returning false if it wasn't
+ * present.
+ */
+_Bool svm_map_delete(svm_map_t * map, int key_type, reg_t key);
+
+
+/**
+ * The number of keys the map holds.
+ */
+unsigned int svm_map_count(svm_map_t * map);
+
+
+#endif                          /* SIMPLE_VM_MAP_H */
@@ -0,0 +1,195 @@
+/**
+ * simple-vm-native.c - Calling host functions from the virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "simple-vm-native.h"
+
+
+
+/**
+ * Parse the types of a list of values, up to the given terminator,
+ * returning NULL if any is invalid or there are too many.  Otherwise
+ * the count is stored, and the terminator returned.
+ */
+static const char *parse_types(const char *spec, char terminator, unsigned char *types,
+                               unsigned int *count)
+{
+    *count = 0;
+
+    while (*spec != terminator)
+    {
+        if (*count == SVM_NATIVE_VALUES)
+            return NULL;
+
+        if (*spec == 'i')
+            types[*count] = INTEGER;
+        else if (*spec == 's')
+            types[*count] = STRING;
+        else
+            return NULL;
+
+        *count += 1;
+        spec++;
+    }
+    return spec;
+}
+
+
+/**
+ * Register a native function - see the header for the format of the
+ * specification.
+ */
+_Bool svm_register_native(svm_t * cpup, unsigned int id, svm_native_fn * fn,
+                          const char *spec)
+{
+    svm_native_t native;
+
+    if (id > 0xFF)
+        return false;
+
+    memset(&native, '\0', sizeof(native));
+    native.fn = fn;
+
+    if (fn)
+    {
+        if (!spec)
+            return false;
+
+        spec = parse_types(spec, strchr(spec, '>') ? '>' : '\0', native.arg_types,
+                           &native.args);
+        if (spec && (*spec == '>'))
+            spec = parse_types(spec + 1, '\0', native.result_types, &native.results);
+        if (!spec)
+            return false;
+    }
+
+    /* the table is only allocated once something is registered */
+    if (!cpup->natives)
+    {
+        if (!fn)
+            return true;
+
+        cpup->natives = calloc(256, sizeof(svm_native_t));
+        if (!cpup->natives)
+            return false;
+    }
+
+    cpup->natives[id] = native;
+    return true;
+}
+
+
+/**
+ * Call a native function, once for each set of arguments.
+ *
+ * The arguments and results are marshalled through arrays on the C
+ * stack, as neither can outnumber the registers, so nothing need be
+ * allocated.
+ */
+_Bool svm_native_call(svm_t * cpup, unsigned int id, unsigned int result,
+                      unsigned int first, unsigned int calls)
+{
+    svm_value_t args[REGISTER_COUNT];
+    svm_value_t results[REGISTER_COUNT];
+
+    svm_native_t *native = cpup->natives ? &cpup->natives[id] : NULL;
+    if (!native || !native->fn)
+    {
+        svm_default_error_handler(cpup, "Unknown native function");
+        return false;
+    }
+
+    unsigned int nargs = calls * native->args;
+    unsigned int nresults = calls * native->results;
+
+    if ((first + nargs > REGISTER_COUNT) || (result + nresults > REGISTER_COUNT))
+    {
+        svm_default_error_handler(cpup, "Register out of bounds");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < nargs; i++)
+    {
+        unsigned int reg = first + i;
+
+        if (cpup->types[reg] != native->arg_types[i % native->args])
+        {
+            svm_default_error_handler(cpup, REGISTER_IS_STRING(cpup, reg) ?
+                                      "The register doesn't contain an integer" :
+                                      "The register doesn't contain a string");
+            return false;
+        }
+
+        if (REGISTER_IS_STRING(cpup, reg))
+        {
+            args[i].integer = 0;
+            args[i].string = REGISTER_STRING(cpup, reg);
+            args[i].length = strlen(args[i].string);
+        } else
+        {
+            args[i].integer = REGISTER_INTEGER(cpup, reg);
+            args[i].string = NULL;
+            args[i].length = 0;
+        }
+    }
+
+    memset(results, '\0', nresults * sizeof(svm_value_t));
+
+    if (!(*native->fn) (cpup, calls, args, results))
+    {
+        svm_default_error_handler(cpup, "Native function failed");
+        return false;
+    }
+
+    /*
+     * A string result is required, so if one is missing discard them
+     * all, rather than leaving some registers updated.
+     */
+    _Bool missing = false;
+    for (unsigned int i = 0; i < nresults; i++)
+    {
+        if ((native->result_types[i % native->results] == STRING) && !results[i].string)
+            missing = true;
+    }
+
+    if (missing)
+    {
+        for (unsigned int i = 0; i < nresults; i++)
+        {
+            if (native->result_types[i % native->results] == STRING)
+                free(results[i].string);
+        }
+        svm_default_error_handler(cpup, "Native function returned no string");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < nresults; i++)
+    {
+        if (native->result_types[i % native->results] == STRING)
+            REGISTER_SET_STRING(cpup, result + i, results[i].string);
+        else
+            REGISTER_SET_INTEGER(cpup, result + i, results[i].integer);
+    }
+
+    return true;
+}
@@ -0,0 +1,108 @@
+/**
+ * simple-vm-native.h - Calling host functions from the virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#ifndef SIMPLE_VM_NATIVE_H
+#define SIMPLE_VM_NATIVE_H 1
+
+
+#include "simple-vm.h"
+
+
+/**
+ * The largest number of arguments, or results, a native function may
+ * have.
+ */
+#define SVM_NATIVE_VALUES 16
+
+
+/**
+ * An argument passed to, or a result returned from, a native function.
+ *
+ * An integer is held in `integer`.  A string argument is given in
+ * `string`, along with its `length`, and belongs to the register it came
+ * from, so it must not be modified or kept.  A string result must be
+ * allocated with `malloc`, and the register it is stored in takes it
+ * over - its `length` is ignored.
+ */
+typedef struct svm_value {
+    uint64_t integer;
+    char *string;
+    size_t length;
+} svm_value_t;
+
+
+/**
+ * The signature of a native function.
+ *
+ * The function is given the arguments of `calls` calls at once: those
+ * of the first call, followed by those of the second, and so on.  It
+ * stores the results of each call in the same way, and returns true.
+ *
+ * If it returns false the error-handler is invoked, and the results are
+ * discarded - so the function must free any strings it had stored.
+ */
+typedef _Bool svm_native_fn(svm_t * cpup, unsigned int calls,
+                            const svm_value_t * args, svm_value_t * results);
+
+
+/**
+ * A registered native function, and the types of its arguments and
+ * results - see `enum register_types`.
+ */
+typedef struct svm_native {
+    svm_native_fn *fn;
+    unsigned int args;
+    unsigned int results;
+    unsigned char arg_types[SVM_NATIVE_VALUES];
+    unsigned char result_types[SVM_NATIVE_VALUES];
+} svm_native_t;
+
+
+/**
+ * Register a native function, which CALL_NATIVE may then call with the
+ * given id, from 0 to 255, replacing any function registered with it
+ * before.  A NULL function removes the registration.
+ *
+ * The specification gives the type of each argument, 'i' for an integer
+ * or 's' for a string, optionally followed by '>' and the types of the
+ * results.  For example "is>i" takes an integer and a string, and
+ * returns an integer.
+ *
+ * Returns false if the id or the specification is invalid, or memory
+ * could not be allocated.
+ */
+_Bool svm_register_native(svm_t * cpup, unsigned int id, svm_native_fn * fn,
+                          const char *spec);
+
+
+/**
+ * Call the native function with the given id `calls` times, with the
+ * arguments of each call in consecutive registers from `first`, and
+ * store the results of each in consecutive registers from `result`.
+ *
+ * Returns false if the function isn't registered, the registers hold
+ * the wrong types, or the function fails, having invoked the
+ * error-handler.
+ */
+_Bool svm_native_call(svm_t * cpup, unsigned int id, unsigned int result,
+                      unsigned int first, unsigned int calls);
+
+
+#endif                          /* SIMPLE_VM_NATIVE_H */
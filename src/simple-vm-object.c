@@ -0,0 +1,156 @@
+/**
+ * simple-vm-object.c - Loading object-files for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "simple-vm-object.h"
+
+
+
+/**
+ * Does the given memory start with an object-file header?
+ */
+_Bool svm_object_is(const unsigned char *data, unsigned int size)
+{
+    if (!data || (size < sizeof(svm_object_header_t)))
+        return false;
+
+    return (memcmp(data, SVM_OBJECT_MAGIC, 4) == 0);
+}
+
+
+/**
+ * Calculate the 32-bit FNV-1a hash of the given memory.
+ */
+uint32_t svm_object_checksum(const unsigned char *data, unsigned int size)
+{
+    uint32_t hash = 2166136261u;
+
+    for (unsigned int i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * Is the given section wholly within the file, suitably aligned, and a
+ * whole number of entries of the given size?
+ */
+static _Bool section_valid(const svm_object_section_t * s, uint32_t length,
+                           unsigned int entry)
+{
+    if (s->size == 0)
+        return true;
+
+    if ((s->offset % 8) || (s->offset < sizeof(svm_object_header_t)))
+        return false;
+
+    if ((s->offset > length) || (s->size > length - s->offset))
+        return false;
+
+    return ((s->size % entry) == 0);
+}
+
+
+/**
+ * Load an object-file.
+ */
+_Bool svm_object_load(const unsigned char *data, unsigned int size, svm_object_t * out)
+{
+    if (!out || !svm_object_is(data, size) || ((uintptr_t) data % 8))
+        return false;
+
+    memset(out, '\0', sizeof(svm_object_t));
+
+    const svm_object_header_t *h = (const svm_object_header_t *) data;
+
+    if ((h->version != SVM_OBJECT_VERSION) || (h->length > size) ||
+        (h->length < sizeof(svm_object_header_t)))
+        return false;
+
+    if (svm_object_checksum(data + sizeof(svm_object_header_t),
+                            h->length - sizeof(svm_object_header_t)) != h->checksum)
+        return false;
+
+    if (!section_valid(&h->code, h->length, 1) ||
+        !section_valid(&h->strings, h->length, sizeof(svm_object_string_t)) ||
+        !section_valid(&h->pool, h->length, 1) ||
+        !section_valid(&h->relocations, h->length, sizeof(svm_object_relocation_t)) ||
+        !section_valid(&h->symbols, h->length, sizeof(svm_object_symbol_t)))
+        return false;
+
+    /**
+     * The code must fit in RAM, and the pool must be terminated so that
+     * names within it can't run off the end.
+     */
+    if ((h->code.size == 0) || (h->code.size > 0xFFFF) || (h->entry >= 0xFFFF))
+        return false;
+
+    if (h->pool.size && (data[h->pool.offset + h->pool.size - 1] != '\0'))
+        return false;
+
+    out->header = h;
+    out->code = data + h->code.offset;
+    out->code_size = h->code.size;
+    out->strings = (const svm_object_string_t *) (data + h->strings.offset);
+    out->string_count = h->strings.size / sizeof(svm_object_string_t);
+    out->pool = (const char *) (data + h->pool.offset);
+    out->pool_size = h->pool.size;
+    out->relocations = (const svm_object_relocation_t *) (data + h->relocations.offset);
+    out->relocation_count = h->relocations.size / sizeof(svm_object_relocation_t);
+    out->symbols = (const svm_object_symbol_t *) (data + h->symbols.offset);
+    out->symbol_count = h->symbols.size / sizeof(svm_object_symbol_t);
+
+    /**
+     * Every entry must refer to something which exists.
+     */
+    for (unsigned int i = 0; i < out->string_count; i++)
+    {
+        const svm_object_string_t *s = &out->strings[i];
+
+        if ((s->address > out->code_size) || (s->length > out->code_size - s->address) ||
+            (s->offset > out->pool_size) || (s->length >= out->pool_size - s->offset))
+            return false;
+    }
+
+    for (unsigned int i = 0; i < out->relocation_count; i++)
+    {
+        const svm_object_relocation_t *r = &out->relocations[i];
+
+        if ((out->code_size < 2) || (r->address > out->code_size - 2) ||
+            (r->target > 0xFFFF))
+            return false;
+    }
+
+    for (unsigned int i = 0; i < out->symbol_count; i++)
+    {
+        const svm_object_symbol_t *s = &out->symbols[i];
+
+        if ((s->address > out->code_size) || (s->name >= out->pool_size))
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,186 @@
+/**
+ * simple-vm-object.h - The object-file format for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#ifndef SIMPLE_VM_OBJECT_H
+#define SIMPLE_VM_OBJECT_H 1
+
+
+#include <stdint.h>
+
+#include "simple-vm.h"
+
+
+/**
+ *
+ * An object-file wraps the raw bytecode the machine executes with the
+ * information a consumer would otherwise have to rediscover by decoding
+ * it.  It is laid out as:
+ *
+ *    header
+ *    code         - The bytecode, exactly as it would appear in a .raw file.
+ *    strings      - An svm_object_string for each string constant.
+ *    pool         - The text of strings and symbol-names, NUL-terminated,
+ *                   with duplicates stored only once.
+ *    relocations  - An svm_object_relocation for each jump, call, or
+ *                   stored address which refers to a label.
+ *    symbols      - An svm_object_symbol for each label (optional).
+ *
+ * All values are little-endian, and each section starts at an offset
+ * which is a multiple of eight, so once a file has been read, or mapped,
+ * the structures below may be used in-place without any parsing.
+ *
+ * The checksum is the 32-bit FNV-1a hash of every byte which follows
+ * the header.
+ *
+ */
+
+
+/**
+ * The magic number which starts every object-file.
+ *
+ * 'S' (0x53) isn't a valid opcode, and is reserved so that no extension
+ * may claim it, so no raw program can be mistaken for one.
+ */
+#define SVM_OBJECT_MAGIC "SVMO"
+
+
+/**
+ * The version of the format described here.
+ */
+#define SVM_OBJECT_VERSION 1
+
+
+/**
+ * The location of a section, relative to the start of the file.
+ */
+typedef struct svm_object_section {
+    uint32_t offset;
+    uint32_t size;
+} svm_object_section_t;
+
+
+/**
+ * The header found at the start of each object-file.
+ */
+typedef struct svm_object_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;
+
+    /**
+     * The size of the whole file, and the checksum of everything
+     * following this header.
+     */
+    uint32_t length;
+    uint32_t checksum;
+
+    /**
+     * The address execution starts from.
+     */
+    uint32_t entry;
+    uint32_t reserved;
+
+    svm_object_section_t code;
+    svm_object_section_t strings;
+    svm_object_section_t pool;
+    svm_object_section_t relocations;
+    svm_object_section_t symbols;
+} svm_object_header_t;
+
+
+/**
+ * A string constant, used by the instruction whose text starts at the
+ * given address.
+ */
+typedef struct svm_object_string {
+    uint32_t address;
+    uint32_t length;
+    uint32_t offset;            /* within the pool */
+    uint32_t reserved;
+} svm_object_string_t;
+
+
+/**
+ * The two bytes at the given address hold the address of the target.
+ */
+typedef struct svm_object_relocation {
+    uint32_t address;
+    uint32_t target;
+} svm_object_relocation_t;
+
+
+/**
+ * A label, and its address.
+ */
+typedef struct svm_object_symbol {
+    uint32_t address;
+    uint32_t name;              /* within the pool */
+} svm_object_symbol_t;
+
+
+/**
+ * A loaded object-file.
+ *
+ * Every pointer refers to the memory the object was loaded from, so
+ * that must remain valid for as long as this is used.
+ */
+typedef struct svm_object {
+    const svm_object_header_t *header;
+
+    const unsigned char *code;
+    unsigned int code_size;
+
+    const svm_object_string_t *strings;
+    unsigned int string_count;
+
+    const char *pool;
+    unsigned int pool_size;
+
+    const svm_object_relocation_t *relocations;
+    unsigned int relocation_count;
+
+    const svm_object_symbol_t *symbols;
+    unsigned int symbol_count;
+} svm_object_t;
+
+
+/**
+ * Does the given memory start with an object-file header?
+ */
+_Bool svm_object_is(const unsigned char *data, unsigned int size);
+
+
+/**
+ * Calculate the checksum of the given memory.
+ */
+uint32_t svm_object_checksum(const unsigned char *data, unsigned int size);
+
+
+/**
+ * Load the object-file held in the given memory, which must be aligned
+ * to eight bytes - as memory returned by malloc, or mmap, is.
+ *
+ * The header, sections, and every entry of each table are checked, and
+ * false is returned if any of them are invalid.
+ */
+_Bool svm_object_load(const unsigned char *data, unsigned int size, svm_object_t * out);
+
+
+#endif                          /* SIMPLE_VM_OBJECT_H */
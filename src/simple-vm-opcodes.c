@@ -24,6 +24,12 @@
 
 #include "simple-vm.h"
 #include "simple-vm-opcodes.h"
+#include "simple-vm-vector.h"
+#include "simple-vm-hash.h"
+#include "simple-vm-map.h"
+#include "simple-vm-regex.h"
+#include "simple-vm-native.h"
+#include "simple-vm-extension.h"
 
 
 
@@ -45,6 +51,19 @@
 #define BYTES_TO_ADDR(one,two) (one + ( 256 * two ))
 
 
+/**
+ * Record a taken control-flow edge in the coverage bitmap, if enabled.
+ *
+ * As with afl each address is hashed to a location, and the source is
+ * shifted so that A->B and B->A are distinct edges.
+ */
+#define EDGE_LOCATION(ip) ( ( (unsigned int)(ip) * 2654435761u ) >> 16 )
+#define RECORD_EDGE(from,to) { if ( svm->coverage ) \
+                                  svm->coverage[ ( EDGE_LOCATION(to) ^ ( EDGE_LOCATION(from) >> 1 ) ) \
+                                                 & ( SVM_COVERAGE_SIZE - 1 ) ]++; \
+                             }
+
+
 
 
 
@@ -54,8 +73,16 @@
  * It's a little longer than I'd usually use for a macro, but it saves
  * all the typing and redundency defining: add, sub, div, mod, xor, or.
  *
+ * The result is given by `expression`, which may refer to the values
+ * of the two source registers as `val1` and `val2`.  The C and O flags
+ * are given by `carry` and `overflow`, which may also refer to the
+ * `result`.
+ *
  */
-#define MATH_OPERATION(function,operator)  void function(struct svm * svm) \
+#define MATH_OPERATION(function,operator) \
+    MATH_EXPRESSION(function, #operator, val1 operator val2, false, false)
+
+#define MATH_EXPRESSION(function,operator,expression,carry,overflow)  void function(struct svm * svm) \
 { \
     /* get the destination register */ \
     unsigned int reg = next_byte(svm); \
@@ -63,38 +90,60 @@
 \
     /* get the source register */ \
     unsigned int src1 = next_byte(svm); \
-    BOUNDS_TEST_REGISTER(reg); \
+    BOUNDS_TEST_REGISTER(src1); \
 \
     /* get the source register */\
     unsigned int src2 = next_byte(svm);\
-    BOUNDS_TEST_REGISTER(reg);\
+    BOUNDS_TEST_REGISTER(src2);\
 \
     if (getenv("DEBUG") != NULL)\
-        printf( #function "(Register:%d = Register:%d " #operator " Register:%d)\n", reg, src1, src2); \
-\
-    /* if the result-register stores a string .. free it */\
-    if ((svm->registers[reg].type == STRING) && (svm->registers[reg].content.string))\
-        free(svm->registers[reg].content.string);\
+        printf( #function "(Register:%d = Register:%d " operator " Register:%d)\n", reg, src1, src2); \
 \
     /* \
      * Ensure both source registers have integer values.\
+     *\
+     * The arithmetic is unsigned, so wraps around rather than overflowing.\
      */\
-    int val1 = get_int_reg(svm, src1);\
-    int val2 = get_int_reg(svm, src2);\
+    uint64_t val1 = get_int_reg(svm, src1);\
+    uint64_t val2 = get_int_reg(svm, src2);\
 \
     /** \
      * Store the result.\
      */\
-    svm->registers[reg].content.integer = val1 operator val2; \
-    svm->registers[reg].type = INTEGER; \
+    uint64_t result = expression; \
+    REGISTER_SET_INTEGER(svm, reg, result); \
 \
-    /**\
-     * Zero result? \
-     */\
-    if (svm->registers[reg].content.integer == 0)\
-        svm->flags.z = true;\
-        else\
-        svm->flags.z = false;\
+    set_flags(svm, result, carry, overflow); \
+\
+    /* handle the next instruction */ \
+    svm->ip += 1; \
+}
+
+
+/**
+ * This is a macro definition for an operation which counts bits.
+ *
+ * The result is given by `expression`, which may refer to the value of
+ * the source register as `val`, and the Z-flag is set if it is zero.
+ */
+#define COUNT_OPERATION(function,name,expression)  void function(struct svm * svm) \
+{ \
+    /* get the destination register */ \
+    unsigned int reg = next_byte(svm); \
+    BOUNDS_TEST_REGISTER(reg); \
+\
+    /* get the source register */ \
+    unsigned int src = next_byte(svm); \
+    BOUNDS_TEST_REGISTER(src); \
+\
+    if (getenv("DEBUG") != NULL)\
+        printf( name "(Register:%d = Register:%d)\n", reg, src); \
+\
+    uint64_t val = get_int_reg(svm, src);\
+\
+    REGISTER_SET_INTEGER(svm, reg, expression); \
+\
+    set_flags(svm, REGISTER_INTEGER(svm, reg), false, false);\
 \
     /* handle the next instruction */ \
     svm->ip += 1; \
@@ -109,9 +158,42 @@
  * Foward declarations for code in this module which is not exported.
  */
 char *get_string_reg(svm_t * cpu, int reg);
-int get_int_reg(svm_t * cpu, int reg);
+uint64_t get_int_reg(svm_t * cpu, int reg);
 char *string_from_stack(svm_t * svm);
 unsigned char next_byte(svm_t * svm);
+uint64_t next_immediate(svm_t * svm, int bytes);
+void int_store(struct svm *svm, int bytes);
+void divide(struct svm *svm, _Bool remainder);
+void cmp_immediate(struct svm *svm, int bytes);
+void set_flags(svm_t * svm, uint64_t result, _Bool carry, _Bool overflow);
+void compare(svm_t * svm, uint64_t val1, uint64_t val2);
+void compare_registers(svm_t * svm, unsigned int reg1, unsigned int reg2);
+_Bool multiply_overflows(uint64_t val1, uint64_t val2, _Bool is_signed);
+_Bool condition(svm_t * svm, int cond);
+void branch(svm_t * svm, unsigned int from, const char *name, _Bool taken);
+void jump_if(svm_t * svm, int cond);
+void call(svm_t * svm, unsigned int from, unsigned int offset);
+_Bool stack_reserve(svm_t * svm, unsigned int count);
+void stack_release(svm_t * svm, int sp);
+_Bool local_entry(svm_t * svm, const char *name, int *entry);
+_Bool effective_address(svm_t * svm, uint64_t * address, char *error);
+unsigned char bank_read(svm_t * svm, uint64_t address);
+_Bool ram_address(svm_t * svm, unsigned int reg, uint64_t * address);
+_Bool ram_length(svm_t * svm, unsigned int reg, uint64_t * length);
+uint64_t ram_run(uint64_t address, uint64_t length);
+_Bool bank_write(svm_t * svm, uint64_t address, unsigned char val);
+void memory_load(struct svm *svm, const char *name, int bytes);
+void memory_store(struct svm *svm, const char *name, int bytes);
+_Bool vector_kind(svm_t * svm, int operations, int *operation, int *width);
+_Bool vector_array(svm_t * svm, unsigned int reg, uint64_t count, int width,
+                   unsigned char **array);
+_Bool hash_algorithm(svm_t * svm, int *algorithm);
+uint64_t hash(int algorithm, const unsigned char *data, size_t length);
+svm_map_t *map_handle(svm_t * svm, unsigned int reg);
+svm_regex_t *regex_lookup(svm_t * svm, uint32_t key, const char *pattern,
+                          unsigned int length);
+void regex_match(svm_t * svm, unsigned int reg, unsigned int first, _Bool captures,
+                 svm_regex_t * regex);
 
 
 /**
@@ -121,8 +203,8 @@ unsigned char next_byte(svm_t * svm);
  */
 char *get_string_reg(svm_t * cpu, int reg)
 {
-    if (cpu->registers[reg].type == STRING)
-        return (cpu->registers[reg].content.string);
+    if (REGISTER_IS_STRING(cpu, reg))
+        return (REGISTER_STRING(cpu, reg));
 
     svm_default_error_handler(cpu, "The register deesn't contain a string");
     return NULL;
@@ -134,10 +216,10 @@ char *get_string_reg(svm_t * cpu, int reg)
  *
  * NOTE: This function is not exported outside this compilation-unit.
  */
-int get_int_reg(svm_t * cpu, int reg)
+uint64_t get_int_reg(svm_t * cpu, int reg)
 {
-    if (cpu->registers[reg].type == INTEGER)
-        return (cpu->registers[reg].content.integer);
+    if (REGISTER_IS_INTEGER(cpu, reg))
+        return (REGISTER_INTEGER(cpu, reg));
 
     svm_default_error_handler(cpu, "The register doesn't contain an integer");
     return 0;
@@ -217,6 +299,198 @@ unsigned char next_byte(svm_t * svm)
 }
 
 
+/**
+ * Read an immediate value of the given number of bytes, low byte first,
+ * from the current instruction-pointer.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+uint64_t next_immediate(svm_t * svm, int bytes)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t) next_byte(svm) << (8 * i);
+
+    return value;
+}
+
+
+/**
+ * Set the flags from the result of an operation.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void set_flags(svm_t * svm, uint64_t result, _Bool carry, _Bool overflow)
+{
+    svm->flags.z = (result == 0);
+    svm->flags.s = (result >> 63);
+    svm->flags.c = carry;
+    svm->flags.o = overflow;
+}
+
+
+/**
+ * Set the flags as if the second value was subtracted from the first.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void compare(svm_t * svm, uint64_t val1, uint64_t val2)
+{
+    uint64_t result = val1 - val2;
+
+    set_flags(svm, result, val1 < val2, ((val1 ^ val2) & (val1 ^ result)) >> 63);
+}
+
+
+/**
+ * Compare the contents of two registers.
+ *
+ * Strings are ordered as strcmp orders them, and registers of different
+ * types are never equal.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void compare_registers(svm_t * svm, unsigned int reg1, unsigned int reg2)
+{
+    if (svm->types[reg1] != svm->types[reg2])
+    {
+        set_flags(svm, 1, false, false);
+        return;
+    }
+
+    if (REGISTER_IS_STRING(svm, reg1))
+    {
+        int cmp = strcmp(REGISTER_STRING(svm, reg1), REGISTER_STRING(svm, reg2));
+
+        set_flags(svm, (uint64_t) (int64_t) cmp, cmp < 0, false);
+    } else
+    {
+        compare(svm, REGISTER_INTEGER(svm, reg1), REGISTER_INTEGER(svm, reg2));
+    }
+}
+
+
+/**
+ * Does multiplying the given values overflow, when treated as signed or
+ * unsigned?
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool multiply_overflows(uint64_t val1, uint64_t val2, _Bool is_signed)
+{
+    if (is_signed)
+    {
+        int64_t result;
+        return __builtin_mul_overflow((int64_t) val1, (int64_t) val2, &result);
+    } else
+    {
+        uint64_t result;
+        return __builtin_mul_overflow(val1, val2, &result);
+    }
+}
+
+
+/**
+ * Test the given condition against the flags.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool condition(svm_t * svm, int cond)
+{
+    flag_t f = svm->flags;
+
+    switch (cond)
+    {
+    case COND_Z:
+        return f.z;
+    case COND_NZ:
+        return !f.z;
+    case COND_C:
+        return f.c;
+    case COND_NC:
+        return !f.c;
+    case COND_S:
+        return f.s;
+    case COND_NS:
+        return !f.s;
+    case COND_O:
+        return f.o;
+    case COND_NO:
+        return !f.o;
+    case COND_LT:
+        return (f.s != f.o);
+    case COND_GE:
+        return (f.s == f.o);
+    case COND_LE:
+        return (f.z || (f.s != f.o));
+    case COND_GT:
+        return (!f.z && (f.s == f.o));
+    case COND_BE:
+        return (f.c || f.z);
+    case COND_A:
+        return (!f.c && !f.z);
+    }
+    return false;
+}
+
+
+/**
+ * Read the address which ends a jump instruction, and jump to it if the
+ * jump is taken.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void branch(svm_t * svm, unsigned int from, const char *name, _Bool taken)
+{
+    /**
+     * Read the two bytes which will build up the destination
+     */
+    unsigned int off1 = next_byte(svm);
+    unsigned int off2 = next_byte(svm);
+
+    /**
+     * Convert to the offset in our code-segment.
+     */
+    int offset = BYTES_TO_ADDR(off1, off2);
+
+    if (getenv("DEBUG") != NULL)
+        printf("%s(Offset:%d [Hex:%04X]\n", name, offset, offset);
+
+    if (taken)
+    {
+        RECORD_EDGE(from, offset);
+        svm->ip = offset;
+    } else
+    {
+        /* handle the next instruction */
+        svm->ip += 1;
+    }
+}
+
+
+/**
+ * Jump to the given address if the given condition holds.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void jump_if(svm_t * svm, int cond)
+{
+    static const char *names[COND_MAX] = {
+        "JUMP_Z", "JUMP_NZ", "JUMP_C", "JUMP_NC", "JUMP_S", "JUMP_NS",
+        "JUMP_O", "JUMP_NO", "JUMP_LT", "JUMP_GE", "JUMP_LE", "JUMP_GT",
+        "JUMP_BE", "JUMP_A"
+    };
+
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
+    branch(svm, from, names[cond], condition(svm, cond));
+}
+
+
 /**
  ** Start implementation of virtual machine opcodes.
  **
@@ -260,7 +534,13 @@ void op_nop(struct svm *svm)
 }
 
 
-void op_divide(struct svm * svm)
+/**
+ * Divide one register by another, storing either the quotient or the
+ * remainder.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void divide(struct svm *svm, _Bool remainder)
 {
     /* get the destination register */
     unsigned int reg = next_byte(svm);
@@ -268,24 +548,21 @@ void op_divide(struct svm * svm)
 
     /* get the source register */
     unsigned int src1 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src1);
 
     /* get the source register */
     unsigned int src2 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src2);
 
     if (getenv("DEBUG") != NULL)
-        printf( "DIV(Register:%d = Register:%d / Register:%d)\n", reg, src1, src2);
-
-    /* if the result-register stores a string .. free it */
-    if ((svm->registers[reg].type == STRING) && (svm->registers[reg].content.string))
-        free(svm->registers[reg].content.string);
+        printf( "%s(Register:%d = Register:%d %s Register:%d)\n",
+                remainder ? "MOD" : "DIV", reg, src1, remainder ? "%" : "/", src2);
 
     /*
      * Ensure both source registers have integer values.
      */
-    int val1 = get_int_reg(svm, src1);
-    int val2 = get_int_reg(svm, src2);
+    int64_t val1 = (int64_t) get_int_reg(svm, src1);
+    int64_t val2 = (int64_t) get_int_reg(svm, src2);
 
     if ( val2 == 0 )
     {
@@ -295,23 +572,37 @@ void op_divide(struct svm * svm)
 
     /**
      * Store the result.
+     *
+     * Division is signed, and the one case which overflows - the most
+     * negative value divided by -1 - wraps around to itself, leaving no
+     * remainder.
      */
-    svm->registers[reg].content.integer = val1 / val2;
-    svm->registers[reg].type = INTEGER;
+    _Bool overflow = ((val1 == INT64_MIN) && (val2 == -1));
 
-    /**
-     * Zero result?
-     */
-    if (svm->registers[reg].content.integer == 0)
-        svm->flags.z = true;
-        else
-            svm->flags.z = false;
+    if (overflow)
+        REGISTER_SET_INTEGER(svm, reg, remainder ? 0 : (uint64_t) INT64_MIN);
+    else
+        REGISTER_SET_INTEGER(svm, reg, remainder ? val1 % val2 : val1 / val2);
+
+    set_flags(svm, REGISTER_INTEGER(svm, reg), false, overflow && !remainder);
 
     /* handle the next instruction */
     svm->ip += 1;
 }
 
 
+void op_divide(struct svm * svm)
+{
+    divide(svm, false);
+}
+
+
+void op_modulo(struct svm * svm)
+{
+    divide(svm, true);
+}
+
+
 /**
  * Store the contents of one register in another.
  */
@@ -330,21 +621,11 @@ void op_reg_store(struct svm *svm)
     if (getenv("DEBUG") != NULL)
         printf("STORE(Reg%02x will be set to contents of Reg%02x)\n", dst, src);
 
-    /* Free the existing string, if present */
-    if ((svm->registers[dst].type == STRING) && (svm->registers[dst].content.string))
-        free(svm->registers[dst].content.string);
-
-
     /* if storing a string - then use strdup */
-    if (svm->registers[src].type == STRING)
-    {
-        svm->registers[dst].type = STRING;
-        svm->registers[dst].content.string = strdup(svm->registers[src].content.string);
-    } else
-    {
-        svm->registers[dst].type = svm->registers[src].type;
-        svm->registers[dst].content.integer = svm->registers[src].content.integer;
-    }
+    if (REGISTER_IS_STRING(svm, src))
+        REGISTER_SET_STRING(svm, dst, strdup(REGISTER_STRING(svm, src)));
+    else
+        REGISTER_SET_INTEGER(svm, dst, REGISTER_INTEGER(svm, src));
 
 
     /* handle the next instruction */
@@ -353,34 +634,58 @@ void op_reg_store(struct svm *svm)
 
 
 /**
- * Store an integer in a register.
+ * Store an integer, which is encoded in the given number of bytes, in
+ * a register.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
  */
-void op_int_store(struct svm *svm)
+void int_store(struct svm *svm, int bytes)
 {
     /* get the register number to store in */
     unsigned int reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
     /* get the value */
-    unsigned int val1 = next_byte(svm);
-    unsigned int val2 = next_byte(svm);
-    int value = BYTES_TO_ADDR(val1, val2);
+    uint64_t value = next_immediate(svm, bytes);
 
     if (getenv("DEBUG") != NULL)
-        printf("STORE_INT(Reg:%02x) => %04d [Hex:%04x]\n", reg, value, value);
+        printf("STORE_INT(Reg:%02x) => %04" PRIu64 " [Hex:%04" PRIx64 "]\n", reg, value,
+               value);
 
-    /* if the register stores a string .. free it */
-    if ((svm->registers[reg].type == STRING) && (svm->registers[reg].content.string))
-        free(svm->registers[reg].content.string);
-
-    svm->registers[reg].content.integer = value;
-    svm->registers[reg].type = INTEGER;
+    REGISTER_SET_INTEGER(svm, reg, value);
 
     /* handle the next instruction */
     svm->ip += 1;
 }
 
 
+/**
+ * Store an integer in a register.
+ */
+void op_int_store(struct svm *svm)
+{
+    int_store(svm, 2);
+}
+
+
+/**
+ * Store a 32-bit integer in a register.
+ */
+void op_int_store32(struct svm *svm)
+{
+    int_store(svm, 4);
+}
+
+
+/**
+ * Store a 64-bit integer in a register.
+ */
+void op_int_store64(struct svm *svm)
+{
+    int_store(svm, 8);
+}
+
+
 /**
  * Print the integer contents of the given register.
  */
@@ -394,12 +699,13 @@ void op_int_print(struct svm *svm)
         printf("INT_PRINT(Register %d)\n", reg);
 
     /* get the register contents. */
-    int val = get_int_reg(svm, reg);
+    uint64_t val = get_int_reg(svm, reg);
 
     if (getenv("DEBUG") != NULL)
-        printf("[STDOUT] Register R%02d => %d [Hex:%04x]\n", reg, val, val);
+        printf("[STDOUT] Register R%02d => %" PRId64 " [Hex:%04" PRIx64 "]\n", reg,
+               val, val);
     else
-        printf("0x%04X", val);
+        printf("0x%04" PRIX64, val);
 
 
     /* handle the next instruction */
@@ -419,15 +725,14 @@ void op_int_tostring(struct svm *svm)
         printf("INT_TOSTRING(Register %d)\n", reg);
 
     /* get the contents of the register */
-    int cur = get_int_reg(svm, reg);
+    int64_t cur = (int64_t) get_int_reg(svm, reg);
 
-    /* allocate a buffer. */
-    svm->registers[reg].type = STRING;
-    svm->registers[reg].content.string = malloc(10);
+    /* allocate a buffer, large enough for any signed 64-bit value. */
+    REGISTER_SET_STRING(svm, reg, malloc(21));
 
     /* store the string-value */
-    memset(svm->registers[reg].content.string, '\0', 10);
-    sprintf(svm->registers[reg].content.string, "%d", cur);
+    memset(REGISTER_STRING(svm, reg), '\0', 21);
+    sprintf(REGISTER_STRING(svm, reg), "%" PRId64, cur);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -447,17 +752,8 @@ void op_int_random(struct svm *svm)
         printf("INT_RANDOM(Register %d)\n", reg);
 
 
-    /**
-     * If we already have a string in the register delete it.
-     */
-    if ((svm->registers[reg].type == STRING) && (svm->registers[reg].content.string))
-    {
-        free(svm->registers[reg].content.string);
-    }
-
-    /* set the value. */
-    svm->registers[reg].type = INTEGER;
-    svm->registers[reg].content.integer = rand() % 0xFFFF;
+    /* set the value, deleting any string the register held. */
+    REGISTER_SET_INTEGER(svm, reg, rand() % 0xFFFF);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -477,18 +773,9 @@ void op_string_store(struct svm *svm)
     char *str = string_from_stack(svm);
 
     /**
-     * If we already have a string in the register delete it.
-     */
-    if ((svm->registers[reg].type == STRING) && (svm->registers[reg].content.string))
-    {
-        free(svm->registers[reg].content.string);
-    }
-
-    /**
-     * Now store the new string.
+     * Now store the new string, deleting any string the register held.
      */
-    svm->registers[reg].type = STRING;
-    svm->registers[reg].content.string = str;
+    REGISTER_SET_STRING(svm, reg, str);
 
     if (getenv("DEBUG") != NULL)
         printf("STRING_STORE(Register %d) = '%s'\n", reg, str);
@@ -535,11 +822,11 @@ void op_string_concat(struct svm *svm)
 
     /* get the source register */
     unsigned int src1 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src1);
 
     /* get the source register */
     unsigned int src2 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    BOUNDS_TEST_REGISTER(src2);
 
     if (getenv("DEBUG") != NULL)
         printf("STRING_CONCAT(Register:%d = Register:%d + Register:%d)\n",
@@ -568,12 +855,8 @@ void op_string_concat(struct svm *svm)
     sprintf(tmp, "%s%s", str1, str2);
 
 
-    /* if the destination-register currently contains a string .. free it */
-    if ((svm->registers[reg].type == STRING) && (svm->registers[reg].content.string))
-        free(svm->registers[reg].content.string);
-
-    svm->registers[reg].content.string = tmp;
-    svm->registers[reg].type = STRING;
+    /* store the result, freeing any string the destination held */
+    REGISTER_SET_STRING(svm, reg, tmp);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -598,6 +881,7 @@ void op_string_system(struct svm *svm)
     if (getenv("FUZZ") != NULL)
     {
         printf("Fuzzing - skipping execution of: %s\n", str);
+        svm->ip += 1;
         return;
     }
 
@@ -622,14 +906,10 @@ void op_string_toint(struct svm *svm)
 
     /* get the string and convert to integer */
     char *str = get_string_reg(svm, reg);
-    int i = atoi(str);
-
-    /* free the old version */
-    free(svm->registers[reg].content.string);
+    uint64_t i = (uint64_t) strtoll(str, NULL, 10);
 
-    /* set the int. */
-    svm->registers[reg].type = INTEGER;
-    svm->registers[reg].content.integer = i;
+    /* set the int, freeing the old version. */
+    REGISTER_SET_INTEGER(svm, reg, i);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -641,6 +921,11 @@ void op_string_toint(struct svm *svm)
  */
 void op_jump_to(struct svm *svm)
 {
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
     /**
      * Read the two bytes which will build up the destination
      */
@@ -655,6 +940,7 @@ void op_jump_to(struct svm *svm)
     if (getenv("DEBUG") != NULL)
         printf("JUMP_TO(Offset:%d [Hex:%04X]\n", offset, offset);
 
+    RECORD_EDGE(from, offset);
     svm->ip = offset;
 }
 
@@ -664,30 +950,7 @@ void op_jump_to(struct svm *svm)
  */
 void op_jump_z(struct svm *svm)
 {
-    /**
-     * Read the two bytes which will build up the destination
-     */
-    unsigned int off1 = next_byte(svm);
-    unsigned int off2 = next_byte(svm);
-
-    /**
-     * Convert to the offset in our code-segment.
-     */
-    int offset = BYTES_TO_ADDR(off1, off2);
-
-    if (getenv("DEBUG") != NULL)
-        printf("JUMP_Z(Offset:%d [Hex:%04X]\n", offset, offset);
-
-
-    if (svm->flags.z)
-    {
-        svm->ip = offset;
-    } else
-    {
-        /* handle the next instruction */
-        svm->ip += 1;
-    }
-
+    jump_if(svm, COND_Z);
 }
 
 
@@ -696,37 +959,181 @@ void op_jump_z(struct svm *svm)
  */
 void op_jump_nz(struct svm *svm)
 {
-    /**
-     * Read the two bytes which will build up the destination
-     */
-    unsigned int off1 = next_byte(svm);
-    unsigned int off2 = next_byte(svm);
-
-    /**
-     * Convert to the offset in our code-segment.
-     */
-    int offset = BYTES_TO_ADDR(off1, off2);
+    jump_if(svm, COND_NZ);
+}
 
-    if (getenv("DEBUG") != NULL)
-        printf("JUMP_NZ(Offset:%d [Hex:%04X]\n", offset, offset);
 
-    if (!svm->flags.z)
-    {
-        svm->ip = offset;
-    } else
-    {
-        /* handle the next instruction */
-        svm->ip += 1;
-    }
+/**
+ * Jump to the given address if the C flag is set - i.e. after a
+ * comparison which was unsigned less-than.
+ */
+void op_jump_c(struct svm *svm)
+{
+    jump_if(svm, COND_C);
 }
 
 
-MATH_OPERATION(op_add, +)       // reg_result = reg1 + reg2 ;
-    MATH_OPERATION(op_and, &)   // reg_result = reg1 & reg2 ;
-    MATH_OPERATION(op_sub, -)   // reg_result = reg1 - reg2 ;
-    MATH_OPERATION(op_mul, *)   // reg_result = reg1 * reg2 ;
+/**
+ * Jump to the given address if the C flag is NOT set.
+ */
+void op_jump_nc(struct svm *svm)
+{
+    jump_if(svm, COND_NC);
+}
+
+
+/**
+ * Jump to the given address if the S flag is set.
+ */
+void op_jump_s(struct svm *svm)
+{
+    jump_if(svm, COND_S);
+}
+
+
+/**
+ * Jump to the given address if the S flag is NOT set.
+ */
+void op_jump_ns(struct svm *svm)
+{
+    jump_if(svm, COND_NS);
+}
+
+
+/**
+ * Jump to the given address if the O flag is set.
+ */
+void op_jump_o(struct svm *svm)
+{
+    jump_if(svm, COND_O);
+}
+
+
+/**
+ * Jump to the given address if the O flag is NOT set.
+ */
+void op_jump_no(struct svm *svm)
+{
+    jump_if(svm, COND_NO);
+}
+
+
+/**
+ * Jump to the given address after a signed less-than comparison.
+ */
+void op_jump_lt(struct svm *svm)
+{
+    jump_if(svm, COND_LT);
+}
+
+
+/**
+ * Jump to the given address after a signed greater-or-equal comparison.
+ */
+void op_jump_ge(struct svm *svm)
+{
+    jump_if(svm, COND_GE);
+}
+
+
+/**
+ * Jump to the given address after a signed less-or-equal comparison.
+ */
+void op_jump_le(struct svm *svm)
+{
+    jump_if(svm, COND_LE);
+}
+
+
+/**
+ * Jump to the given address after a signed greater-than comparison.
+ */
+void op_jump_gt(struct svm *svm)
+{
+    jump_if(svm, COND_GT);
+}
+
+
+/**
+ * Jump to the given address after an unsigned less-or-equal comparison.
+ */
+void op_jump_be(struct svm *svm)
+{
+    jump_if(svm, COND_BE);
+}
+
+
+/**
+ * Jump to the given address after an unsigned greater-than comparison.
+ */
+void op_jump_a(struct svm *svm)
+{
+    jump_if(svm, COND_A);
+}
+
+
+/**
+ * Decrement the given register, and jump to the given address if the
+ * result is not zero.
+ *
+ * This replaces a "dec" and "jmpnz", which close most counted loops,
+ * with a single instruction.
+ */
+void op_dec_jump_nz(struct svm *svm)
+{
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
+    /* get the register number to decrement */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    if (getenv("DEBUG") != NULL)
+        printf("DEC_JUMP_NZ(Register %d)\n", reg);
+
+    /* get, decr, set */
+    uint64_t cur = get_int_reg(svm, reg);
+    REGISTER_INTEGER(svm, reg) = cur - 1;
+
+    set_flags(svm, cur - 1, cur == 0, cur == (uint64_t) INT64_MIN);
+
+    branch(svm, from, "DEC_JUMP_NZ", !svm->flags.z);
+}
+
+
+MATH_EXPRESSION(op_add, "+", val1 + val2,     // reg_result = reg1 + reg2 ;
+                result < val1, (~(val1 ^ val2) & (val1 ^ result)) >> 63)
+    MATH_OPERATION(op_and, &)   // reg_result = reg1 & reg2 ;
+    MATH_EXPRESSION(op_sub, "-", val1 - val2, // reg_result = reg1 - reg2 ;
+                    val1 < val2, ((val1 ^ val2) & (val1 ^ result)) >> 63)
+    MATH_EXPRESSION(op_mul, "*", val1 * val2, // reg_result = reg1 * reg2 ;
+                    multiply_overflows(val1, val2, false), multiply_overflows(val1, val2, true))
     MATH_OPERATION(op_xor, ^)   // reg_result = reg1 ^ reg2 ;
     MATH_OPERATION(op_or, |)    // reg_result = reg1 | reg2 ;
+
+/**
+ * Shifts and rotates use the low six bits of the count, so they're
+ * defined for any count, and each compiles to a single host instruction.
+ */
+    MATH_EXPRESSION(op_shl, "<<", val1 << (val2 & 63), false, false)
+    MATH_EXPRESSION(op_shr, ">>", val1 >> (val2 & 63), false, false)
+    MATH_EXPRESSION(op_sar, ">>>", (uint64_t) ((int64_t) val1 >> (val2 & 63)), false, false)
+    MATH_EXPRESSION(op_rol, "rol", (val1 << (val2 & 63)) | (val1 >> ((64 - (val2 & 63)) & 63)),
+                    false, false)
+    MATH_EXPRESSION(op_ror, "ror", (val1 >> (val2 & 63)) | (val1 << ((64 - (val2 & 63)) & 63)),
+                    false, false)
+
+/**
+ * Bit-counts use the compiler builtins, which become single instructions
+ * where the host has them.  The builtins are undefined for zero, where
+ * the leading and trailing counts are 64.
+ */
+    COUNT_OPERATION(op_popcnt, "POPCNT", (uint64_t) __builtin_popcountll(val))
+    COUNT_OPERATION(op_clz, "CLZ", val ? (uint64_t) __builtin_clzll(val) : 64)
+    COUNT_OPERATION(op_ctz, "CTZ", val ? (uint64_t) __builtin_ctzll(val) : 64)
+
 /**
  * Increment the given (integer) register.
  */
@@ -739,16 +1146,1923 @@ void op_inc(struct svm *svm)
     if (getenv("DEBUG") != NULL)
         printf("INC_OP(Register %d)\n", reg);
 
-    /* get, incr, set */
-    int cur = get_int_reg(svm, reg);
-    cur += 1;
-    svm->registers[reg].content.integer = cur;
+    /* get, incr, set */
+    uint64_t cur = get_int_reg(svm, reg);
+    cur += 1;
+    REGISTER_INTEGER(svm, reg) = cur;
+
+    set_flags(svm, cur, cur == 0, cur == (uint64_t) INT64_MIN);
+
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Decrement the given (integer) register.
+ */
+void op_dec(struct svm *svm)
+{
+    /* get the register number to decrement */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    if (getenv("DEBUG") != NULL)
+        printf("DEC_OP(Register %d)\n", reg);
+
+    /* get, decr, set */
+    uint64_t cur = get_int_reg(svm, reg);
+    cur -= 1;
+    REGISTER_INTEGER(svm, reg) = cur;
+
+    set_flags(svm, cur, cur == UINT64_MAX, cur == INT64_MAX);
+
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Compare two registers.  Set the Z-flag if equal, and the others as
+ * described in simple-vm.h.
+ */
+void op_cmp_reg(struct svm *svm)
+{
+    /* get the source register */
+    unsigned int reg1 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg1);
+
+    /* get the source register */
+    unsigned int reg2 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg2);
+
+    if (getenv("DEBUG") != NULL)
+        printf("CMP(Register:%d vs Register:%d)\n", reg1, reg2);
+
+    compare_registers(svm, reg1, reg2);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Compare a register contents with a constant integer, which is encoded
+ * in the given number of bytes.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void cmp_immediate(struct svm *svm, int bytes)
+{
+    /* get the source register */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* get the integer to compare with */
+    uint64_t val = next_immediate(svm, bytes);
+
+    if (getenv("DEBUG") != NULL)
+        printf("CMP_IMMEDIATE(Register:%d vs %" PRIu64 " [Hex:%04" PRIX64 "])\n", reg,
+               val, val);
+
+    compare(svm, get_int_reg(svm, reg), val);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Compare a register contents with a constant integer.
+ */
+void op_cmp_immediate(struct svm *svm)
+{
+    cmp_immediate(svm, 2);
+}
+
+
+/**
+ * Compare a register contents with a constant 32-bit integer.
+ */
+void op_cmp_immediate32(struct svm *svm)
+{
+    cmp_immediate(svm, 4);
+}
+
+
+/**
+ * Compare a register contents with a constant 64-bit integer.
+ */
+void op_cmp_immediate64(struct svm *svm)
+{
+    cmp_immediate(svm, 8);
+}
+
+
+/**
+ * Compare a register contents with the given string.
+ */
+void op_cmp_string(struct svm *svm)
+{
+    /* get the source register */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* Now we get the string to compare against from the stack */
+    char *str = string_from_stack(svm);
+
+    /* get the string content from the register */
+    char *cur = get_string_reg(svm, reg);
+
+    if (getenv("DEBUG") != NULL)
+        printf("Comparing register-%d ('%s') - with string '%s'\n", reg, cur, str);
+
+    /* compare */
+    int cmp = strcmp(cur, str);
+    set_flags(svm, (uint64_t) (int64_t) cmp, cmp < 0, false);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Does the given register contain a string?  Set the Z-flag if so.
+ */
+void op_is_string(struct svm *svm)
+{
+    /* get the register to test */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    if (getenv("DEBUG") != NULL)
+        printf("is register %02X a string?\n", reg);
+
+    set_flags(svm, !REGISTER_IS_STRING(svm, reg), false, false);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Does the given register contain an integer?  Set the Z-flag if so.
+ */
+void op_is_integer(struct svm *svm)
+{
+    /* get the register to test */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    if (getenv("DEBUG") != NULL)
+        printf("is register %02X an integer?\n", reg);
+
+    set_flags(svm, !REGISTER_IS_INTEGER(svm, reg), false, false);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Compare two registers, as CMP_REG does, and jump to the given address
+ * if the encoded condition holds.
+ */
+void op_cmp_jump(struct svm *svm)
+{
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
+    /* get the source registers */
+    unsigned int reg1 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg1);
+
+    unsigned int reg2 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg2);
+
+    /* get the condition */
+    unsigned int cond = next_byte(svm);
+
+    if (getenv("DEBUG") != NULL)
+        printf("CMP_JUMP(Register:%d vs Register:%d, Condition:%d)\n", reg1, reg2, cond);
+
+    if (cond >= COND_MAX)
+    {
+        svm_default_error_handler(svm, "Invalid condition!");
+        return;
+    }
+
+    compare_registers(svm, reg1, reg2);
+    branch(svm, from, "CMP_JUMP", condition(svm, cond));
+}
+
+
+/**
+ * Compare a register with a constant integer, as CMP_IMMEDIATE does, and
+ * jump to the given address if the encoded condition holds.
+ */
+void op_cmp_immediate_jump(struct svm *svm)
+{
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
+    /* get the source register */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* get the integer to compare with, and the condition */
+    uint64_t val = next_immediate(svm, 2);
+    unsigned int cond = next_byte(svm);
+
+    if (getenv("DEBUG") != NULL)
+        printf("CMP_IMMEDIATE_JUMP(Register:%d vs %" PRIu64 ", Condition:%d)\n", reg,
+               val, cond);
+
+    if (cond >= COND_MAX)
+    {
+        svm_default_error_handler(svm, "Invalid condition!");
+        return;
+    }
+
+    compare(svm, get_int_reg(svm, reg), val);
+    branch(svm, from, "CMP_IMMEDIATE_JUMP", condition(svm, cond));
+}
+
+
+/**
+ * Find the compiled form of the given pattern in the machine's cache,
+ * compiling it if it isn't there.
+ *
+ * The cache is indexed by `key`, which is the address of a pattern held
+ * inline, or a hash of one held in a register.  Each entry keeps the
+ * text it was compiled from, so a collision, or code which has been
+ * overwritten, just means the pattern is compiled again.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+svm_regex_t *regex_lookup(svm_t * svm, uint32_t key, const char *pattern,
+                          unsigned int length)
+{
+    if (!svm->regexes)
+    {
+        svm->regexes = calloc(SVM_REGEX_CACHE, sizeof(struct svm_regex *));
+        if (!svm->regexes)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return NULL;
+        }
+    }
+
+    /* the top bits of the product are well mixed */
+    unsigned int slot = ((uint32_t) (key * 0x9E3779B1u) >> 16) & (SVM_REGEX_CACHE - 1);
+
+    svm_regex_t *regex = svm->regexes[slot];
+    if (regex && svm_regex_same(regex, pattern, length))
+        return regex;
+
+    const char *error;
+    svm_regex_t *compiled = svm_regex_compile(pattern, length, &error);
+    if (!compiled)
+    {
+        svm_default_error_handler(svm, error ? (char *) error : "RAM allocation failure.");
+        return NULL;
+    }
+
+    if (getenv("DEBUG") != NULL)
+        printf("Compiled regular expression '%.*s' into slot %u\n", (int) length, pattern,
+               slot);
+
+    svm_regex_free(regex);
+    svm->regexes[slot] = compiled;
+    return compiled;
+}
+
+
+/**
+ * Match the string in the given register against a compiled pattern,
+ * setting the Z-flag if it matches.
+ *
+ * If `captures` is set the offsets of the start and end of the match,
+ * then of each group, are stored in the registers from `first` onwards.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void regex_match(svm_t * svm, unsigned int reg, unsigned int first, _Bool captures,
+                 svm_regex_t * regex)
+{
+    char *subject = get_string_reg(svm, reg);
+    if (!subject)
+        return;
+
+    unsigned int count = 2 * (svm_regex_groups(regex) + 1);
+    if (captures && (first + count > REGISTER_COUNT))
+    {
+        svm_default_error_handler(svm, "Register out of bounds");
+        return;
+    }
+
+    int offsets[2 * (SVM_REGEX_GROUPS + 1)];
+    _Bool found = svm_regex_match(regex, subject, strlen(subject),
+                                  captures ? offsets : NULL);
+
+    if (getenv("DEBUG") != NULL)
+        printf("MATCH(Register:%d ('%s')) -> %s\n", reg, subject,
+               found ? "match" : "no match");
+
+    /**
+     * Groups which took no part in the match are stored as -1.
+     */
+    if (found && captures)
+    {
+        for (unsigned int i = 0; i < count; i++)
+            REGISTER_SET_INTEGER(svm, first + i, (uint64_t) (int64_t) offsets[i]);
+    }
+
+    set_flags(svm, !found, false, false);
+}
+
+
+/**
+ * Match a register against a regular expression held inline.
+ *
+ * The pattern is compiled the first time the instruction is executed,
+ * and cached against its address.
+ */
+void op_match(struct svm *svm)
+{
+    /* get the subject register, and where to store any captures */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    unsigned int first = next_byte(svm);
+    BOUNDS_TEST_REGISTER(first);
+
+    unsigned int captures = next_byte(svm);
+
+    /* get the length of the pattern, and find where it starts */
+    unsigned int len1 = next_byte(svm);
+    unsigned int len2 = next_byte(svm);
+    unsigned int length = BYTES_TO_ADDR(len1, len2);
+    unsigned int start = svm->ip + 1;
+
+    /**
+     * The pattern is used where it lies, unless it wraps around the end
+     * of RAM, in which case it is copied.
+     */
+    char *copy = NULL;
+    const char *pattern = (const char *) svm->code + start;
+
+    if (start + length > 0xFFFF)
+    {
+        copy = malloc(length + 1);
+        if (!copy)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return;
+        }
+        for (unsigned int i = 0; i < length; i++)
+            copy[i] = next_byte(svm);
+        copy[length] = '\0';
+        pattern = copy;
+    }
+    else
+    {
+        svm->ip = start + length - 1;
+    }
+
+    svm_regex_t *regex = regex_lookup(svm, start, pattern, length);
+    free(copy);
+    if (!regex)
+        return;
+
+    regex_match(svm, reg, first, captures != 0, regex);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Match a register against a regular expression held in another.
+ *
+ * The pattern is compiled the first time it is seen, and cached against
+ * its hash.
+ */
+void op_match_reg(struct svm *svm)
+{
+    /* get the subject and pattern registers, and where to store captures */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    unsigned int pattern_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(pattern_reg);
+
+    unsigned int first = next_byte(svm);
+    BOUNDS_TEST_REGISTER(first);
+
+    unsigned int captures = next_byte(svm);
+
+    char *pattern = get_string_reg(svm, pattern_reg);
+    if (!pattern)
+        return;
+
+    size_t length = strlen(pattern);
+    if (length > 0xFFFF)
+    {
+        svm_default_error_handler(svm, "Regular expression is too large");
+        return;
+    }
+
+    uint32_t key = (uint32_t) svm_hash_xxh64(0, (const unsigned char *) pattern, length);
+
+    svm_regex_t *regex = regex_lookup(svm, key, pattern, length);
+    if (!regex)
+        return;
+
+    regex_match(svm, reg, first, captures != 0, regex);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Read from a given address into the specified register.
+ */
+void op_peek(struct svm *svm)
+{
+    /* get the destination register */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* get the address to read from the second register */
+    unsigned int addr = next_byte(svm);
+    BOUNDS_TEST_REGISTER(addr);
+
+    if (getenv("DEBUG") != NULL)
+        printf
+            ("LOAD_FROM_RAM(Register:%d will contain contents of address %04X)\n",
+             reg, addr);
+
+    /* get the address from the register */
+    int64_t adr = (int64_t) get_int_reg(svm, addr);
+    if (adr < 0 || adr > 0xffff)
+        svm_default_error_handler(svm, "Reading from outside RAM");
+
+    /* Read the value from RAM */
+    int val = svm->code[adr];
+
+    /* store the value, freeing any string the register held */
+    REGISTER_SET_INTEGER(svm, reg, val);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+/**
+ * Write a register-contents to memory.
+ */
+void op_poke(struct svm *svm)
+{
+    /* get the destination register */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* get the address to write to from the second register */
+    unsigned int addr = next_byte(svm);
+    BOUNDS_TEST_REGISTER(addr);
+
+    /* Get the value we're to store - only the low byte is used. */
+    unsigned int val = get_int_reg(svm, reg) & 0xFF;
+
+    /* Get the address we're to store it in. */
+    int64_t adr = (int64_t) get_int_reg(svm, addr);
+
+
+    if (getenv("DEBUG") != NULL)
+        printf("STORE_IN_RAM(Address %04" PRIX64 " set to %02X)\n", adr, val);
+
+    if (adr < 0 || adr > 0xffff)
+        svm_default_error_handler(svm, "Writing outside RAM");
+
+    /* do the necessary */
+    svm->code[adr] = val;
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Read the address held in the given register, for the bulk memory
+ * operations.
+ *
+ * Addresses may not be negative, and those beyond the end of RAM wrap
+ * around to the start of it.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool ram_address(svm_t * svm, unsigned int reg, uint64_t * address)
+{
+    int64_t val = (int64_t) get_int_reg(svm, reg);
+
+    if (val < 0)
+    {
+        svm_default_error_handler(svm, "cannot access negative addresses");
+        return false;
+    }
+
+    *address = val % 0xFFFF;
+    return true;
+}
+
+
+/**
+ * Read the length held in the given register, for the bulk memory
+ * operations.
+ *
+ * A negative length is treated as zero, and one larger than RAM is an
+ * error.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool ram_length(svm_t * svm, unsigned int reg, uint64_t * length)
+{
+    int64_t val = (int64_t) get_int_reg(svm, reg);
+
+    if (val > 0xFFFF)
+    {
+        svm_default_error_handler(svm, "cannot access more than all of RAM");
+        return false;
+    }
+
+    *length = (val < 0) ? 0 : val;
+    return true;
+}
+
+
+/**
+ * The number of bytes, from a run of the given length at the given
+ * address, which come before the end of RAM - where the run wraps
+ * around to the start.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+uint64_t ram_run(uint64_t address, uint64_t length)
+{
+    return (length < 0xFFFF - address) ? length : 0xFFFF - address;
+}
+
+
+/**
+ * Copy a chunk of memory.
+ *
+ * The copy gives the same result as copying a byte at a time, from the
+ * start: when the destination lies a short way ahead of the source the
+ * first bytes of the source are repeated over the rest of it, and a
+ * length greater than RAM goes around it again.
+ *
+ * That is done a run at a time, with one memmove for each stretch in
+ * which neither the source nor the destination wraps around the end of
+ * RAM.  Where the destination lies within such a run of the source the
+ * run is copied in steps of their distance, so each step reads only
+ * bytes which the byte-at-a-time loop would have read.
+ */
+void op_memcpy(struct svm *svm)
+{
+    /* get the register number to store to */
+    unsigned int dest_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(dest_reg);
+
+    /* get the register number to copy from */
+    unsigned int src_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(src_reg);
+
+    /* get the register number with the size */
+    unsigned int size_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(size_reg);
+
+    uint64_t src, dest;
+    if (!ram_address(svm, src_reg, &src) || !ram_address(svm, dest_reg, &dest))
+        return;
+
+    /* a negative size copies nothing, and a huge one keeps wrapping */
+    int64_t val = (int64_t) get_int_reg(svm, size_reg);
+    uint64_t size = (val < 0) ? 0 : val;
+
+    if (getenv("DEBUG") != NULL)
+    {
+        printf("Copying %4" PRIx64 " bytes from %04" PRIx64 " to %04" PRIX64 "\n", size,
+               src, dest);
+    }
+
+    for (uint64_t done = 0; (done < size) && (src != dest);)
+    {
+        uint64_t run = ram_run(dest, ram_run(src, size - done));
+
+        /* don't read bytes this run would write before they're read */
+        if ((dest > src) && (dest - src < run))
+            run = dest - src;
+
+        memmove(svm->code + dest, svm->code + src, run);
+
+        src = (src + run) % 0xFFFF;
+        dest = (dest + run) % 0xFFFF;
+        done += run;
+    }
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Fill a chunk of memory with the low byte of a register.
+ */
+void op_memset(struct svm *svm)
+{
+    /* get the register number to store to */
+    unsigned int dest_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(dest_reg);
+
+    /* get the register number with the value */
+    unsigned int val_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(val_reg);
+
+    /* get the register number with the size */
+    unsigned int size_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(size_reg);
+
+    uint64_t dest, size;
+    if (!ram_address(svm, dest_reg, &dest) || !ram_length(svm, size_reg, &size))
+        return;
+
+    unsigned char val = get_int_reg(svm, val_reg) & 0xFF;
+
+    if (getenv("DEBUG") != NULL)
+        printf("Setting %4" PRIx64 " bytes at %04" PRIx64 " to %02X\n", size, dest, val);
+
+    uint64_t run = ram_run(dest, size);
+
+    memset(svm->code + dest, val, run);
+    memset(svm->code, val, size - run);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Compare two chunks of memory.
+ *
+ * The flags are set as if the second was subtracted from the first,
+ * comparing them as memcmp would.
+ */
+void op_memcmp(struct svm *svm)
+{
+    /* get the register numbers with the addresses */
+    unsigned int reg1 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg1);
+
+    unsigned int reg2 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg2);
+
+    /* get the register number with the size */
+    unsigned int size_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(size_reg);
+
+    uint64_t addr1, addr2, size;
+    if (!ram_address(svm, reg1, &addr1) || !ram_address(svm, reg2, &addr2) ||
+        !ram_length(svm, size_reg, &size))
+        return;
+
+    if (getenv("DEBUG") != NULL)
+        printf("Comparing %4" PRIx64 " bytes at %04" PRIx64 " with %04" PRIx64 "\n",
+               size, addr1, addr2);
+
+    /**
+     * Compare in runs which stop whenever either address wraps around.
+     */
+    int cmp = 0;
+    while ((size > 0) && (cmp == 0))
+    {
+        uint64_t run = ram_run(addr2, ram_run(addr1, size));
+
+        cmp = memcmp(svm->code + addr1, svm->code + addr2, run);
+
+        addr1 = (addr1 + run) % 0xFFFF;
+        addr2 = (addr2 + run) % 0xFFFF;
+        size -= run;
+    }
+
+    set_flags(svm, (uint64_t) (int64_t) cmp, cmp < 0, false);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Search a chunk of memory for the low byte of a register.
+ *
+ * If it is found the Z-flag is set, and the address of the first match
+ * is stored in the register which held the address to search from,
+ * otherwise the Z-flag is cleared and that register is unchanged.
+ */
+void op_memchr(struct svm *svm)
+{
+    /* get the register number with the address */
+    unsigned int addr_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(addr_reg);
+
+    /* get the register number with the value */
+    unsigned int val_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(val_reg);
+
+    /* get the register number with the size */
+    unsigned int size_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(size_reg);
+
+    uint64_t addr, size;
+    if (!ram_address(svm, addr_reg, &addr) || !ram_length(svm, size_reg, &size))
+        return;
+
+    unsigned char val = get_int_reg(svm, val_reg) & 0xFF;
+
+    if (getenv("DEBUG") != NULL)
+        printf("Searching %4" PRIx64 " bytes at %04" PRIx64 " for %02X\n", size, addr,
+               val);
+
+    uint64_t run = ram_run(addr, size);
+
+    unsigned char *found = memchr(svm->code + addr, val, run);
+    if (!found)
+        found = memchr(svm->code, val, size - run);
+
+    set_flags(svm, found == NULL, false, false);
+    if (found)
+        REGISTER_SET_INTEGER(svm, addr_reg, found - svm->code);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Read the operands which describe the address used by a load or store -
+ * see `enum address_mode_values` - and calculate it.
+ *
+ * The address must be within RAM, otherwise the given error is raised
+ * and false returned.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool effective_address(svm_t * svm, uint64_t * address, char *error)
+{
+    unsigned int base = next_byte(svm);
+    BOUNDS_TEST_REGISTER(base);
+
+    unsigned int index = next_byte(svm);
+    BOUNDS_TEST_REGISTER(index);
+
+    unsigned int mode = next_byte(svm);
+    int16_t displacement = (int16_t) next_immediate(svm, 2);
+
+    if (mode & ~(ADDRESS_SCALE | ADDRESS_INDEX))
+    {
+        svm_default_error_handler(svm, "Invalid addressing mode");
+        return false;
+    }
+
+    /**
+     * The calculation wraps around, so a negative displacement may be
+     * used to address below the base.
+     */
+    *address = get_int_reg(svm, base) + (uint64_t) (int64_t) displacement;
+
+    if (mode & ADDRESS_INDEX)
+        *address += get_int_reg(svm, index) << (mode & ADDRESS_SCALE);
+
+    if (*address >= 0xFFFF)
+    {
+        svm_default_error_handler(svm, error);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Read a byte from the given address of the current bank.
+ *
+ * Pages which have never been written to read as zero, without being
+ * allocated.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+unsigned char bank_read(svm_t * svm, uint64_t address)
+{
+    if (svm->bank == 0)
+        return svm->code[address];
+
+    if (!svm->pages)
+        return 0;
+
+    unsigned char *page =
+        svm->pages[((svm->bank - 1) * SVM_BANK_PAGES) + (address / SVM_PAGE_SIZE)];
+
+    return page ? page[address % SVM_PAGE_SIZE] : 0;
+}
+
+
+/**
+ * Write a byte to the given address of the current bank, allocating the
+ * page which holds it if this is the first write to that page.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool bank_write(svm_t * svm, uint64_t address, unsigned char val)
+{
+    if (svm->bank == 0)
+    {
+        svm->code[address] = val;
+        return true;
+    }
+
+    if (!svm->pages)
+    {
+        svm->pages = calloc((SVM_BANK_COUNT - 1) * SVM_BANK_PAGES, sizeof(unsigned char *));
+        if (!svm->pages)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return false;
+        }
+    }
+
+    unsigned char **page =
+        &svm->pages[((svm->bank - 1) * SVM_BANK_PAGES) + (address / SVM_PAGE_SIZE)];
+
+    if (!*page)
+    {
+        *page = calloc(1, SVM_PAGE_SIZE);
+        if (!*page)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return false;
+        }
+    }
+
+    (*page)[address % SVM_PAGE_SIZE] = val;
+    return true;
+}
+
+
+/**
+ * Load a little-endian value, of the given number of bytes, from the
+ * current bank into a register.
+ *
+ * Like MEMCPY a value which runs past the end of RAM wraps around to the
+ * start of it.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void memory_load(struct svm *svm, const char *name, int bytes)
+{
+    /* get the destination register */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    uint64_t address;
+    if (!effective_address(svm, &address, "Reading from outside RAM"))
+        return;
+
+    uint64_t val = 0;
+    for (int i = 0; i < bytes; i++)
+        val |= (uint64_t) bank_read(svm, (address + i) % 0xFFFF) << (8 * i);
+
+    if (getenv("DEBUG") != NULL)
+        printf("%s(Register:%d will contain contents of address %04" PRIX64 ")\n", name,
+               reg, address);
+
+    /* store the value, freeing any string the register held */
+    REGISTER_SET_INTEGER(svm, reg, val);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Store the low bytes of a register in the current bank, little-endian.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void memory_store(struct svm *svm, const char *name, int bytes)
+{
+    /* get the register holding the value */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    uint64_t address;
+    if (!effective_address(svm, &address, "Writing outside RAM"))
+        return;
+
+    uint64_t val = get_int_reg(svm, reg);
+
+    if (getenv("DEBUG") != NULL)
+        printf("%s(Address %04" PRIX64 " set to contents of Register:%d)\n", name,
+               address, reg);
+
+    for (int i = 0; i < bytes; i++)
+    {
+        if (!bank_write(svm, (address + i) % 0xFFFF, (val >> (8 * i)) & 0xFF))
+            return;
+    }
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Select the bank which loads and stores address.
+ */
+void op_bank(struct svm *svm)
+{
+    /* get the register holding the bank */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    uint64_t bank = get_int_reg(svm, reg);
+
+    if (getenv("DEBUG") != NULL)
+        printf("BANK(Register %d) => %" PRIu64 "\n", reg, bank);
+
+    if (bank >= SVM_BANK_COUNT)
+    {
+        svm_default_error_handler(svm, "Bank out of range");
+        return;
+    }
+    svm->bank = bank;
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+void op_load8(struct svm *svm)
+{
+    memory_load(svm, "LOAD8", 1);
+}
+
+
+void op_load16(struct svm *svm)
+{
+    memory_load(svm, "LOAD16", 2);
+}
+
+
+void op_load32(struct svm *svm)
+{
+    memory_load(svm, "LOAD32", 4);
+}
+
+
+void op_load64(struct svm *svm)
+{
+    memory_load(svm, "LOAD64", 8);
+}
+
+
+void op_store8(struct svm *svm)
+{
+    memory_store(svm, "STORE8", 1);
+}
+
+
+void op_store16(struct svm *svm)
+{
+    memory_store(svm, "STORE16", 2);
+}
+
+
+void op_store32(struct svm *svm)
+{
+    memory_store(svm, "STORE32", 4);
+}
+
+
+void op_store64(struct svm *svm)
+{
+    memory_store(svm, "STORE64", 8);
+}
+
+/**
+ * Ensure the stack has room for `count` more entries, growing it if it
+ * hasn't, and return false if it can't.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool stack_reserve(svm_t * svm, unsigned int count)
+{
+    uint64_t wanted = (uint64_t) svm->SP + count;
+
+    if (wanted <= svm->stack_slots)
+        return true;
+
+    if (wanted > SVM_STACK_SIZE)
+    {
+        svm_default_error_handler(svm, "stack overflow - stack is full");
+        return false;
+    }
+
+    uint64_t slots = svm->stack_slots ? svm->stack_slots : 256;
+    while (slots < wanted)
+        slots *= 2;
+    if (slots > SVM_STACK_SIZE)
+        slots = SVM_STACK_SIZE;
+
+    /* entry N is held at index N, so allow for the unused index zero */
+    reg_t *stack = realloc(svm->stack, (slots + 1) * sizeof(reg_t));
+    if (stack)
+        svm->stack = stack;
+
+    unsigned char *types = stack ? realloc(svm->stack_types, slots + 1) : NULL;
+    if (types)
+        svm->stack_types = types;
+
+    if (!stack || !types)
+    {
+        svm_default_error_handler(svm, "RAM allocation failure.");
+        return false;
+    }
+
+    svm->stack_slots = slots;
+    return true;
+}
+
+
+/**
+ * Discard the entries above the given one, freeing any strings they
+ * hold, so that it is left at the top of the stack.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void stack_release(svm_t * svm, int sp)
+{
+    while (svm->SP > sp)
+    {
+        if (svm->stack_types[svm->SP] == STRING)
+            free(svm->stack[svm->SP].string);
+        svm->SP -= 1;
+    }
+}
+
+
+/**
+ * Push the contents of a given register onto the stack.
+ *
+ * A string is copied, so the register keeps its own.
+ */
+void op_stack_push(struct svm *svm)
+{
+    /* get the register to push */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    if (!stack_reserve(svm, 1))
+        return;
+
+    reg_t val = svm->registers[reg];
+    if (REGISTER_IS_STRING(svm, reg))
+    {
+        val.string = strdup(val.string);
+        if (!val.string)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return;
+        }
+    }
+
+    if (getenv("DEBUG") != NULL)
+    {
+        if (REGISTER_IS_STRING(svm, reg))
+            printf("PUSH(Register %d [=%s])\n", reg, val.string);
+        else
+            printf("PUSH(Register %d [=%04" PRIx64 "])\n", reg, val.integer);
+    }
+
+    /* store it */
+    svm->SP += 1;
+    svm->stack[svm->SP] = val;
+    svm->stack_types[svm->SP] = svm->types[reg];
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Pop the topmost entry from the stack into the given register.
+ */
+void op_stack_pop(struct svm *svm)
+{
+    /* get the register to pop */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* ensure we're not outside the stack. */
+    if (svm->SP <= 0)
+    {
+        svm_default_error_handler(svm, "stack overflow - stack is empty");
+        return;
+    }
+
+    /* Get the value from the stack. */
+    reg_t val = svm->stack[svm->SP];
+    unsigned char type = svm->stack_types[svm->SP];
+    svm->SP -= 1;
+
+    if (getenv("DEBUG") != NULL)
+    {
+        if (type == STRING)
+            printf("POP(Register %d) => %s\n", reg, val.string);
+        else
+            printf("POP(Register %d) => %04" PRIx64 "\n", reg, val.integer);
+    }
+
+    /* store the value, the register taking over any string */
+    if (type == STRING)
+        REGISTER_SET_STRING(svm, reg, val.string);
+    else
+        REGISTER_SET_INTEGER(svm, reg, val.integer);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Return from a call - by popping the return address from the stack
+ * and jumping to it.
+ */
+void op_stack_ret(struct svm *svm)
+{
+    /* ensure we're not outside the stack. */
+    if (svm->SP <= 0)
+    {
+        svm_default_error_handler(svm, "stack overflow - stack is empty");
+        return;
+    }
+
+    if (svm->stack_types[svm->SP] != INTEGER)
+    {
+        svm_default_error_handler(svm, "RET found a string on the stack");
+        return;
+    }
+
+    /* Get the value from the stack - an address, so only 16-bits matter. */
+    unsigned int val = svm->stack[svm->SP].integer & 0xFFFF;
+    svm->SP -= 1;
+
+    if (getenv("DEBUG") != NULL)
+        printf("RET() => %04x\n", val);
+
+
+    /* update our instruction pointer. */
+    RECORD_EDGE(svm->ip, val);
+    svm->ip = val;
+
+}
+
+
+/**
+ * Call a routine - push the return address onto the stack.
+ */
+void op_stack_call(struct svm *svm)
+{
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
+    /**
+     * Read the two bytes which will build up the destination
+     */
+    unsigned int off1 = next_byte(svm);
+    unsigned int off2 = next_byte(svm);
+
+    /**
+     * Convert to the offset in our code-segment.
+     */
+    int offset = BYTES_TO_ADDR(off1, off2);
+
+    call(svm, from, offset);
+}
+
+
+/**
+ * Push the address past the current instruction, and jump to the given
+ * address.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+void call(svm_t * svm, unsigned int from, unsigned int offset)
+{
+    if (!stack_reserve(svm, 1))
+        return;
+
+    /**
+     * Now we've got to save the address past this instruction
+     * on the stack so that the "ret(urn)" instruction will go
+     * to the correct place.
+     */
+    svm->SP += 1;
+    svm->stack[svm->SP].integer = svm->ip + 1;
+    svm->stack_types[svm->SP] = INTEGER;
+
+    /**
+     * Now we've saved the return-address we can update the IP
+     */
+    RECORD_EDGE(from, offset);
+    svm->ip = offset;
+
+}
+
+
+/**
+ * Begin a frame for a routine: push the frame pointer, point it at the
+ * entry which holds it, and reserve the given number of local variables
+ * above that, each zero.
+ */
+void op_stack_enter(struct svm *svm)
+{
+    unsigned int count = next_immediate(svm, 2);
+
+    if (getenv("DEBUG") != NULL)
+        printf("ENTER(%u locals)\n", count);
+
+    if (!stack_reserve(svm, count + 1))
+        return;
+
+    svm->SP += 1;
+    svm->stack[svm->SP].integer = svm->FP;
+    svm->stack_types[svm->SP] = INTEGER;
+    svm->FP = svm->SP;
+
+    memset(svm->stack + svm->SP + 1, '\0', count * sizeof(reg_t));
+    memset(svm->stack_types + svm->SP + 1, INTEGER, count);
+    svm->SP += count;
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * End the current frame: discard its local variables, and anything
+ * pushed since, then restore the previous frame pointer.  The return
+ * address of the routine is then at the top of the stack.
+ */
+void op_stack_leave(struct svm *svm)
+{
+    if (svm->FP <= 0)
+    {
+        svm_default_error_handler(svm, "LEAVE outside of any frame");
+        return;
+    }
+
+    /*
+     * The saved frame pointer may have been popped, or overwritten,
+     * by a broken program.
+     */
+    if ((svm->FP > svm->SP) ||
+        (svm->stack_types[svm->FP] != INTEGER) ||
+        (svm->stack[svm->FP].integer >= (uint64_t) svm->FP))
+    {
+        svm_default_error_handler(svm, "LEAVE found a corrupted frame");
+        return;
+    }
+
+    stack_release(svm, svm->FP);
+    svm->FP = svm->stack[svm->FP].integer;
+    svm->SP -= 1;
+
+    if (getenv("DEBUG") != NULL)
+        printf("LEAVE() => frame %d\n", svm->FP);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Read the signed offset of a local variable from the instruction, and
+ * find the entry of the stack it refers to, relative to the frame
+ * pointer.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool local_entry(svm_t * svm, const char *name, int *entry)
+{
+    int16_t offset = (int16_t) next_immediate(svm, 2);
+
+    *entry = svm->FP + offset;
+
+    if (getenv("DEBUG") != NULL)
+        printf("%s(Local %d) => entry %d\n", name, offset, *entry);
+
+    if ((offset == 0) || (*entry < 1) || (*entry > svm->SP))
+    {
+        svm_default_error_handler(svm, "Local variable out of bounds");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Load a register with a copy of a local variable.
+ */
+void op_local_get(struct svm *svm)
+{
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    int entry;
+    if (!local_entry(svm, "LOCAL_GET", &entry))
+        return;
+
+    if (svm->stack_types[entry] == STRING)
+    {
+        char *copy = strdup(svm->stack[entry].string);
+        if (!copy)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return;
+        }
+        REGISTER_SET_STRING(svm, reg, copy);
+    }
+    else
+        REGISTER_SET_INTEGER(svm, reg, svm->stack[entry].integer);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Store a copy of a register in a local variable.
+ */
+void op_local_set(struct svm *svm)
+{
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    int entry;
+    if (!local_entry(svm, "LOCAL_SET", &entry))
+        return;
+
+    reg_t val = svm->registers[reg];
+    if (REGISTER_IS_STRING(svm, reg))
+    {
+        val.string = strdup(val.string);
+        if (!val.string)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return;
+        }
+    }
+
+    if (svm->stack_types[entry] == STRING)
+        free(svm->stack[entry].string);
+
+    svm->stack[entry] = val;
+    svm->stack_types[entry] = svm->types[reg];
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Jump to the address held in the given register.
+ */
+void op_jump_reg(struct svm *svm)
+{
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
+    /* get the register holding the destination */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* an address, so only 16-bits matter. */
+    unsigned int offset = get_int_reg(svm, reg) & 0xFFFF;
+
+    if (getenv("DEBUG") != NULL)
+        printf("JUMP_REG(Register:%d [Hex:%04X])\n", reg, offset);
+
+    RECORD_EDGE(from, offset);
+    svm->ip = offset;
+}
+
+
+/**
+ * Call the routine at the address held in the given register.
+ */
+void op_call_reg(struct svm *svm)
+{
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
+    /* get the register holding the destination */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* an address, so only 16-bits matter. */
+    unsigned int offset = get_int_reg(svm, reg) & 0xFFFF;
+
+    if (getenv("DEBUG") != NULL)
+        printf("CALL_REG(Register:%d [Hex:%04X])\n", reg, offset);
+
+    call(svm, from, offset);
+}
+
+
+/**
+ * Jump via a table of addresses, indexed by the given register.
+ *
+ * The table holds a two-byte count of entries, followed by a two-byte
+ * address for each.  If the index is beyond the end of the table then
+ * execution continues with the next instruction instead.
+ */
+void op_jump_table(struct svm *svm)
+{
+    /**
+     * The address of this instruction, for coverage purposes.
+     */
+    unsigned int from = svm->ip;
+
+    /* get the register holding the index */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /**
+     * Read the two bytes which will build up the address of the table.
+     */
+    unsigned int off1 = next_byte(svm);
+    unsigned int off2 = next_byte(svm);
+    unsigned int table = BYTES_TO_ADDR(off1, off2);
+
+    uint64_t index = get_int_reg(svm, reg);
+
+    if (getenv("DEBUG") != NULL)
+        printf("JUMP_TABLE(Register:%d [Index:%" PRIu64 "], Table:%04X)\n", reg, index,
+               table);
+
+    if (table + 2 > 0xFFFF)
+    {
+        svm_default_error_handler(svm, "Reading from outside RAM");
+        return;
+    }
+
+    uint64_t count = BYTES_TO_ADDR(svm->code[table], svm->code[table + 1]);
+
+    if (index >= count)
+    {
+        /* handle the next instruction */
+        svm->ip += 1;
+        return;
+    }
+
+    unsigned int entry = table + 2 + (2 * index);
+    if (entry + 2 > 0xFFFF)
+    {
+        svm_default_error_handler(svm, "Reading from outside RAM");
+        return;
+    }
+
+    unsigned int offset = BYTES_TO_ADDR(svm->code[entry], svm->code[entry + 1]);
+
+    RECORD_EDGE(from, offset);
+    svm->ip = offset;
+}
+
+
+/**
+ * Read the byte which follows an array operation, holding the width of
+ * its elements and the operation to perform - see
+ * `enum vector_width_values`.
+ *
+ * There are `operations` valid operations, and the width is returned in
+ * bytes.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool vector_kind(svm_t * svm, int operations, int *operation, int *width)
+{
+    unsigned int kind = next_byte(svm);
+
+    *operation = kind >> 2;
+
+    if (((kind & 0x03) > VECTOR_32) || (*operation >= operations))
+    {
+        svm_default_error_handler(svm, "Invalid vector operation");
+        return false;
+    }
+
+    *width = 1 << (kind & 0x03);
+    return true;
+}
+
+
+/**
+ * Find the array of `count` elements whose address is held in the given
+ * register.
+ *
+ * Unlike the other bulk memory operations arrays don't wrap around the
+ * end of RAM, the whole of the array must be within it.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool vector_array(svm_t * svm, unsigned int reg, uint64_t count, int width,
+                   unsigned char **array)
+{
+    int64_t address = (int64_t) get_int_reg(svm, reg);
+
+    if ((address < 0) || ((uint64_t) address + (count * width) > 0xFFFF))
+    {
+        svm_default_error_handler(svm, "Array outside RAM");
+        return false;
+    }
+
+    *array = svm->code + address;
+    return true;
+}
+
+
+/**
+ * Apply an operation to each pair of elements of two arrays, storing the
+ * results in a third.
+ */
+void op_vector_map(struct svm *svm)
+{
+    int operation, width;
+    if (!vector_kind(svm, VECTOR_OPERATION_MAX, &operation, &width))
+        return;
+
+    /* get the register numbers with the addresses */
+    unsigned int dest_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(dest_reg);
+
+    unsigned int reg1 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg1);
+
+    unsigned int reg2 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg2);
+
+    /* get the register number with the count */
+    unsigned int count_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(count_reg);
+
+    uint64_t count;
+    unsigned char *dest, *a, *b;
+    if (!ram_length(svm, count_reg, &count) ||
+        !vector_array(svm, dest_reg, count, width, &dest) ||
+        !vector_array(svm, reg1, count, width, &a) ||
+        !vector_array(svm, reg2, count, width, &b))
+        return;
+
+    if (getenv("DEBUG") != NULL)
+        printf("VECTOR_MAP(Operation:%d, Width:%d, Count:%" PRIu64 ")\n", operation,
+               width, count);
+
+    svm_vector_map(operation, width, dest, a, b, count);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Store the sum, minimum, or maximum of the elements of an array in a
+ * register, setting the flags from it.
+ */
+void op_vector_reduce(struct svm *svm)
+{
+    int reduction, width;
+    if (!vector_kind(svm, VECTOR_REDUCTION_MAX, &reduction, &width))
+        return;
+
+    /* get the register number to store the result in */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* get the register numbers with the address, and the count */
+    unsigned int array_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(array_reg);
+
+    unsigned int count_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(count_reg);
+
+    uint64_t count;
+    unsigned char *a;
+    if (!ram_length(svm, count_reg, &count) ||
+        !vector_array(svm, array_reg, count, width, &a))
+        return;
+
+    uint64_t result = svm_vector_reduce(reduction, width, a, count);
+
+    if (getenv("DEBUG") != NULL)
+        printf("VECTOR_REDUCE(Reduction:%d, Width:%d, Count:%" PRIu64 ") -> %" PRIu64
+               "\n", reduction, width, count, result);
+
+    REGISTER_SET_INTEGER(svm, reg, result);
+    set_flags(svm, result, false, false);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Store the sum of the products of the elements of two arrays in a
+ * register, setting the flags from it.
+ */
+void op_vector_dot(struct svm *svm)
+{
+    int unused, width;
+    if (!vector_kind(svm, 1, &unused, &width))
+        return;
+
+    /* get the register number to store the result in */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* get the register numbers with the addresses, and the count */
+    unsigned int reg1 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg1);
+
+    unsigned int reg2 = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg2);
+
+    unsigned int count_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(count_reg);
+
+    uint64_t count;
+    unsigned char *a, *b;
+    if (!ram_length(svm, count_reg, &count) ||
+        !vector_array(svm, reg1, count, width, &a) ||
+        !vector_array(svm, reg2, count, width, &b))
+        return;
+
+    uint64_t result = svm_vector_dot(width, a, b, count);
+
+    if (getenv("DEBUG") != NULL)
+        printf("VECTOR_DOT(Width:%d, Count:%" PRIu64 ") -> %" PRIu64 "\n", width, count,
+               result);
+
+    REGISTER_SET_INTEGER(svm, reg, result);
+    set_flags(svm, result, false, false);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Store the running totals of the elements of one array in another.
+ */
+void op_vector_scan(struct svm *svm)
+{
+    int unused, width;
+    if (!vector_kind(svm, 1, &unused, &width))
+        return;
+
+    /* get the register numbers with the addresses, and the count */
+    unsigned int dest_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(dest_reg);
+
+    unsigned int array_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(array_reg);
+
+    unsigned int count_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(count_reg);
+
+    uint64_t count;
+    unsigned char *dest, *a;
+    if (!ram_length(svm, count_reg, &count) ||
+        !vector_array(svm, dest_reg, count, width, &dest) ||
+        !vector_array(svm, array_reg, count, width, &a))
+        return;
+
+    if (getenv("DEBUG") != NULL)
+        printf("VECTOR_SCAN(Width:%d, Count:%" PRIu64 ")\n", width, count);
+
+    svm_vector_scan(width, dest, a, count);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Sort an array in place.
+ *
+ * The whole of the array is checked to lie within RAM before any of it
+ * is touched.
+ */
+void op_vector_sort(struct svm *svm)
+{
+    int order, width;
+    if (!vector_kind(svm, VECTOR_ORDER_MAX, &order, &width))
+        return;
+
+    /* get the register numbers with the address, and the count */
+    unsigned int array_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(array_reg);
+
+    unsigned int count_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(count_reg);
+
+    uint64_t count;
+    unsigned char *a;
+    if (!ram_length(svm, count_reg, &count) ||
+        !vector_array(svm, array_reg, (order & VECTOR_PAIRS) ? 2 * count : count, width,
+                      &a))
+        return;
+
+    if (getenv("DEBUG") != NULL)
+        printf("VECTOR_SORT(Order:%d, Width:%d, Count:%" PRIu64 ")\n", order, width,
+               count);
+
+    if (!svm_vector_sort(order, width, a, count))
+    {
+        svm_default_error_handler(svm, "RAM allocation failure.");
+        return;
+    }
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Search a sorted array for the value held in a register.
+ *
+ * If it is found the Z-flag is set, and its index is stored in the
+ * result register.  Otherwise the Z-flag is cleared, and the index at
+ * which it would be inserted is stored instead.
+ */
+void op_vector_search(struct svm *svm)
+{
+    int order, width;
+    if (!vector_kind(svm, VECTOR_ORDER_MAX, &order, &width))
+        return;
+
+    /* get the register number to store the index in */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* get the register numbers with the address, the count, and the key */
+    unsigned int array_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(array_reg);
+
+    unsigned int count_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(count_reg);
+
+    unsigned int key_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(key_reg);
+
+    uint64_t count;
+    unsigned char *a;
+    if (!ram_length(svm, count_reg, &count) ||
+        !vector_array(svm, array_reg, (order & VECTOR_PAIRS) ? 2 * count : count, width,
+                      &a))
+        return;
+
+    uint64_t key = get_int_reg(svm, key_reg);
+
+    _Bool found;
+    unsigned int index = svm_vector_search(order, width, a, count, key, &found);
+
+    if (getenv("DEBUG") != NULL)
+        printf("VECTOR_SEARCH(Order:%d, Width:%d, Count:%" PRIu64 ", Key:%" PRIu64
+               ") -> %u%s\n", order, width, count, key, index, found ? "" : " (missing)");
+
+    REGISTER_SET_INTEGER(svm, reg, index);
+    set_flags(svm, !found, false, false);
+
+    /* handle the next instruction */
+    svm->ip += 1;
+}
+
+
+/**
+ * Read the byte which follows a hashing operation, selecting the
+ * algorithm to use - see `enum hash_values`.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+_Bool hash_algorithm(svm_t * svm, int *algorithm)
+{
+    *algorithm = next_byte(svm);
+
+    if (*algorithm >= HASH_MAX)
+    {
+        svm_default_error_handler(svm, "Invalid hash algorithm");
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Hash the given memory with the given algorithm.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
+ */
+uint64_t hash(int algorithm, const unsigned char *data, size_t length)
+{
+    switch (algorithm)
+    {
+    case HASH_CRC32C:
+        return svm_hash_crc32c(0, data, length);
+    case HASH_XXH64:
+        return svm_hash_xxh64(0, data, length);
+    case HASH_ADLER32:
+        return svm_hash_adler32(1, data, length);
+    }
+    return 0;
+}
+
+
+/**
+ * Hash a chunk of memory, storing the result in a register.
+ *
+ * As with the other bulk memory operations a chunk which runs past the
+ * end of RAM wraps around to its start, in which case it is gathered
+ * into a temporary buffer first.
+ */
+void op_hash_memory(struct svm *svm)
+{
+    int algorithm;
+    if (!hash_algorithm(svm, &algorithm))
+        return;
+
+    /* get the register number to store the result in */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
+
+    /* get the register numbers with the address, and the size */
+    unsigned int addr_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(addr_reg);
+
+    unsigned int size_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(size_reg);
+
+    uint64_t addr, size;
+    if (!ram_address(svm, addr_reg, &addr) || !ram_length(svm, size_reg, &size))
+        return;
+
+    uint64_t run = ram_run(addr, size);
+    uint64_t result;
+
+    if (run == size)
+    {
+        result = hash(algorithm, svm->code + addr, size);
+    } else
+    {
+        unsigned char *tmp = malloc(size);
+        if (!tmp)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return;
+        }
+
+        memcpy(tmp, svm->code + addr, run);
+        memcpy(tmp + run, svm->code, size - run);
+
+        result = hash(algorithm, tmp, size);
+        free(tmp);
+    }
 
-    if (svm->registers[reg].content.integer == 0)
-        svm->flags.z = true;
-    else
-        svm->flags.z = false;
+    if (getenv("DEBUG") != NULL)
+        printf("HASH_MEMORY(Algorithm:%d, Address:%04" PRIx64 ", Size:%" PRIu64 ") -> %"
+               PRIx64 "\n", algorithm, addr, size, result);
 
+    REGISTER_SET_INTEGER(svm, reg, result);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -756,27 +3070,34 @@ void op_inc(struct svm *svm)
 
 
 /**
- * Decrement the given (integer) register.
+ * Hash the contents of a string register, storing the result in a
+ * register.
  */
-void op_dec(struct svm *svm)
+void op_hash_string(struct svm *svm)
 {
-    /* get the register number to decrement */
+    int algorithm;
+    if (!hash_algorithm(svm, &algorithm))
+        return;
+
+    /* get the register number to store the result in */
     unsigned int reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        printf("DEC_OP(Register %d)\n", reg);
+    /* get the register number with the string */
+    unsigned int str_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(str_reg);
 
-    /* get, decr, set */
-    int cur = get_int_reg(svm, reg);
-    cur -= 1;
-    svm->registers[reg].content.integer = cur;
+    char *str = get_string_reg(svm, str_reg);
+    if (!str)
+        return;
 
-    if (svm->registers[reg].content.integer == 0)
-        svm->flags.z = true;
-    else
-        svm->flags.z = false;
+    uint64_t result = hash(algorithm, (const unsigned char *) str, strlen(str));
 
+    if (getenv("DEBUG") != NULL)
+        printf("HASH_STRING(Algorithm:%d, Register:%d) -> %" PRIx64 "\n", algorithm,
+               str_reg, result);
+
+    REGISTER_SET_INTEGER(svm, reg, result);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -784,67 +3105,76 @@ void op_dec(struct svm *svm)
 
 
 /**
- * Compare two registers.  Set the Z-flag if equal.
+ * Find the hash-map whose handle is held in the given register.
+ *
+ * NOTE: This function is not exported outside this compilation-unit.
  */
-void op_cmp_reg(struct svm *svm)
+svm_map_t *map_handle(svm_t * svm, unsigned int reg)
 {
-    /* get the source register */
-    unsigned int reg1 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg1);
-
-    /* get the source register */
-    unsigned int reg2 = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg2);
-
-    if (getenv("DEBUG") != NULL)
-        printf("CMP(Register:%d vs Register:%d)\n", reg1, reg2);
-
-    svm->flags.z = false;
+    uint64_t handle = get_int_reg(svm, reg);
 
-    if (svm->registers[reg1].type == svm->registers[reg2].type)
+    if ((handle == 0) || (handle > svm->map_slots) || !svm->maps[handle - 1])
     {
-        if (svm->registers[reg1].type == STRING)
-        {
-            if (strcmp
-                (svm->registers[reg1].content.string,
-                 svm->registers[reg2].content.string) == 0)
-                svm->flags.z = true;
-        } else
-        {
-            if (svm->registers[reg1].content.integer ==
-                svm->registers[reg2].content.integer)
-                svm->flags.z = true;
-        }
+        svm_default_error_handler(svm, "Invalid map handle");
+        return NULL;
     }
 
-    /* handle the next instruction */
-    svm->ip += 1;
+    return svm->maps[handle - 1];
 }
 
 
 /**
- * Compare a register contents with a constant integer.
+ * Create an empty hash-map, storing its handle in a register.
+ *
+ * The handles of freed maps are reused, and the table of them grows as
+ * needed, up to SVM_MAP_COUNT.
  */
-void op_cmp_immediate(struct svm *svm)
+void op_map_new(struct svm *svm)
 {
-    /* get the source register */
+    /* get the register number to store the handle in */
     unsigned int reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    /* get the integer to compare with */
-    unsigned int val1 = next_byte(svm);
-    unsigned int val2 = next_byte(svm);
-    int val = BYTES_TO_ADDR(val1, val2);
+    unsigned int slot = 0;
+    while ((slot < svm->map_slots) && svm->maps[slot])
+        slot++;
 
-    if (getenv("DEBUG") != NULL)
-        printf("CMP_IMMEDIATE(Register:%d vs %d [Hex:%04X])\n", reg, val, val);
+    if (slot == svm->map_slots)
+    {
+        if (svm->map_slots == SVM_MAP_COUNT)
+        {
+            svm_default_error_handler(svm, "Too many maps");
+            return;
+        }
+
+        unsigned int slots = svm->map_slots ? svm->map_slots * 2 : 8;
+        if (slots > SVM_MAP_COUNT)
+            slots = SVM_MAP_COUNT;
+
+        struct svm_map **maps = realloc(svm->maps, slots * sizeof(struct svm_map *));
+        if (!maps)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return;
+        }
+
+        memset(maps + svm->map_slots, '\0',
+               (slots - svm->map_slots) * sizeof(struct svm_map *));
+        svm->maps = maps;
+        svm->map_slots = slots;
+    }
 
-    svm->flags.z = false;
+    svm->maps[slot] = svm_map_new();
+    if (!svm->maps[slot])
+    {
+        svm_default_error_handler(svm, "RAM allocation failure.");
+        return;
+    }
 
-    int cur = (int) get_int_reg(svm, reg);
+    if (getenv("DEBUG") != NULL)
+        printf("MAP_NEW(Register:%d) -> %u\n", reg, slot + 1);
 
-    if (cur == val)
-        svm->flags.z = true;
+    REGISTER_SET_INTEGER(svm, reg, slot + 1);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -852,28 +3182,37 @@ void op_cmp_immediate(struct svm *svm)
 
 
 /**
- * Compare a register contents with the given string.
+ * Associate the contents of one register with those of another, in a
+ * hash-map.
+ *
+ * Either may be an integer or a string, and the map keeps its own copy
+ * of strings.
  */
-void op_cmp_string(struct svm *svm)
+void op_map_set(struct svm *svm)
 {
-    /* get the source register */
-    unsigned int reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    /* get the register numbers with the handle, the key, and the value */
+    unsigned int map_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(map_reg);
 
-    /* Now we get the string to compare against from the stack */
-    char *str = string_from_stack(svm);
+    unsigned int key_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(key_reg);
 
-    /* get the string content from the register */
-    char *cur = get_string_reg(svm, reg);
+    unsigned int val_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(val_reg);
+
+    svm_map_t *map = map_handle(svm, map_reg);
+    if (!map)
+        return;
 
     if (getenv("DEBUG") != NULL)
-        printf("Comparing register-%d ('%s') - with string '%s'\n", reg, cur, str);
+        printf("MAP_SET(Map:%d, Key:%d, Value:%d)\n", map_reg, key_reg, val_reg);
 
-    /* compare */
-    if (strcmp(cur, str) == 0)
-        svm->flags.z = true;
-    else
-        svm->flags.z = false;
+    if (!svm_map_set(map, svm->types[key_reg], svm->registers[key_reg],
+                     svm->types[val_reg], svm->registers[val_reg]))
+    {
+        svm_default_error_handler(svm, "RAM allocation failure.");
+        return;
+    }
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -881,113 +3220,112 @@ void op_cmp_string(struct svm *svm)
 
 
 /**
- * Does the given register contain a string?  Set the Z-flag if so.
+ * Look up a key in a hash-map.
+ *
+ * If it is present the Z-flag is set, and its value stored in the first
+ * register.  Otherwise the Z-flag is cleared and that register is
+ * unchanged.
  */
-void op_is_string(struct svm *svm)
+void op_map_get(struct svm *svm)
 {
-    /* get the register to test */
+    /* get the register numbers for the result, the handle, and the key */
     unsigned int reg = next_byte(svm);
     BOUNDS_TEST_REGISTER(reg);
 
-    if (getenv("DEBUG") != NULL)
-        printf("is register %02X a string?\n", reg);
-
-    if (svm->registers[reg].type == STRING)
-        svm->flags.z = true;
-    else
-        svm->flags.z = false;
+    unsigned int map_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(map_reg);
 
-    /* handle the next instruction */
-    svm->ip += 1;
-}
+    unsigned int key_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(key_reg);
 
+    svm_map_t *map = map_handle(svm, map_reg);
+    if (!map)
+        return;
 
-/**
- * Does the given register contain an integer?  Set the Z-flag if so.
- */
-void op_is_integer(struct svm *svm)
-{
-    /* get the register to test */
-    unsigned int reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    int type;
+    reg_t value;
+    _Bool found = svm_map_get(map, svm->types[key_reg], svm->registers[key_reg], &type,
+                              &value);
 
     if (getenv("DEBUG") != NULL)
-        printf("is register %02X an integer?\n", reg);
+        printf("MAP_GET(Map:%d, Key:%d)%s\n", map_reg, key_reg, found ? "" : " (missing)");
 
-    if (svm->registers[reg].type == INTEGER)
-        svm->flags.z = true;
-    else
-        svm->flags.z = false;
+    if (found && (type == STRING))
+    {
+        char *copy = strdup(value.string);
+        if (!copy)
+        {
+            svm_default_error_handler(svm, "RAM allocation failure.");
+            return;
+        }
+        REGISTER_SET_STRING(svm, reg, copy);
+    } else if (found)
+    {
+        REGISTER_SET_INTEGER(svm, reg, value.integer);
+    }
+
+    set_flags(svm, !found, false, false);
 
     /* handle the next instruction */
     svm->ip += 1;
 }
 
+
 /**
- * Read from a given address into the specified register.
+ * Remove a key from a hash-map, setting the Z-flag if it was present.
  */
-void op_peek(struct svm *svm)
+void op_map_delete(struct svm *svm)
 {
-    /* get the destination register */
-    unsigned int reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
-
-    /* get the address to read from the second register */
-    unsigned int addr = next_byte(svm);
-    BOUNDS_TEST_REGISTER(addr);
+    /* get the register numbers with the handle, and the key */
+    unsigned int map_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(map_reg);
 
-    if (getenv("DEBUG") != NULL)
-        printf
-            ("LOAD_FROM_RAM(Register:%d will contain contents of address %04X)\n",
-             reg, addr);
+    unsigned int key_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(key_reg);
 
-    /* get the address from the register */
-    int adr = get_int_reg(svm, addr);
-    if (adr < 0 || adr > 0xffff)
-        svm_default_error_handler(svm, "Reading from outside RAM");
+    svm_map_t *map = map_handle(svm, map_reg);
+    if (!map)
+        return;
 
-    /* Read the value from RAM */
-    int val = svm->code[adr];
+    _Bool found = svm_map_delete(map, svm->types[key_reg], svm->registers[key_reg]);
 
-    /* if the destination currently contains a string .. free it */
-    if ((svm->registers[reg].type == STRING) && (svm->registers[reg].content.string))
-        free(svm->registers[reg].content.string);
+    if (getenv("DEBUG") != NULL)
+        printf("MAP_DELETE(Map:%d, Key:%d)%s\n", map_reg, key_reg,
+               found ? "" : " (missing)");
 
-    svm->registers[reg].content.integer = val;
-    svm->registers[reg].type = INTEGER;
+    set_flags(svm, !found, false, false);
 
     /* handle the next instruction */
     svm->ip += 1;
 }
 
+
 /**
- * Write a register-contents to memory.
+ * Test whether a hash-map holds a key, setting the Z-flag if it does.
  */
-void op_poke(struct svm *svm)
+void op_map_contains(struct svm *svm)
 {
-    /* get the destination register */
-    unsigned int reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
-
-    /* get the address to write to from the second register */
-    unsigned int addr = next_byte(svm);
-    BOUNDS_TEST_REGISTER(addr);
+    /* get the register numbers with the handle, and the key */
+    unsigned int map_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(map_reg);
 
-    /* Get the value we're to store. */
-    int val = get_int_reg(svm, reg);
+    unsigned int key_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(key_reg);
 
-    /* Get the address we're to store it in. */
-    int adr = get_int_reg(svm, addr);
+    svm_map_t *map = map_handle(svm, map_reg);
+    if (!map)
+        return;
 
+    int type;
+    reg_t value;
+    _Bool found = svm_map_get(map, svm->types[key_reg], svm->registers[key_reg], &type,
+                              &value);
 
     if (getenv("DEBUG") != NULL)
-        printf("STORE_IN_RAM(Address %04X set to %02X)\n", adr, val);
-
-    if (adr < 0 || adr > 0xffff)
-        svm_default_error_handler(svm, "Writing outside RAM");
+        printf("MAP_CONTAINS(Map:%d, Key:%d)%s\n", map_reg, key_reg,
+               found ? "" : " (missing)");
 
-    /* do the necessary */
-    svm->code[adr] = val;
+    set_flags(svm, !found, false, false);
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -995,96 +3333,52 @@ void op_poke(struct svm *svm)
 
 
 /**
- * Copy a chunk of memory.
+ * Store the number of keys a hash-map holds in a register.
  */
-void op_memcpy(struct svm *svm)
+void op_map_count(struct svm *svm)
 {
-    /* get the register number to store to */
-    unsigned int dest_reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(dest_reg);
-
-    /* get the register number to copy from */
-    unsigned int src_reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(src_reg);
-
-    /* get the register number with the size */
-    unsigned int size_reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(size_reg);
+    /* get the register numbers for the result, and the handle */
+    unsigned int reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(reg);
 
-    /**
-     * Now handle the copy.
-     */
-    int src = get_int_reg(svm, src_reg);
-    int dest = get_int_reg(svm, dest_reg);
-    int size = get_int_reg(svm, size_reg);
+    unsigned int map_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(map_reg);
 
-    if ( ( src <0 ) || ( dest < 0 ) )
-    {
-        svm_default_error_handler(svm, "cannot copy to/from negative addresses");
+    svm_map_t *map = map_handle(svm, map_reg);
+    if (!map)
         return;
-    }
-
-    if (getenv("DEBUG") != NULL)
-    {
-        printf("Copying %4x bytes from %04x to %04X\n", size, src, dest);
-    }
-
-    /** Slow, but copes with nulls and allows debugging. */
-    for (int i = 0; i < size; i++)
-    {
-        int sc = src + i;
-        int dt = dest + i;
-
-        /*
-         * Handle wrap-around.
-         *
-         * So copying 0x00FF bytes from 0xFFFE will actually
-         * wrap around to 0x00FE.
-         */
-        while( sc >= 0xFFFF )
-            sc -= 0xFFFF;
-        while( dt >= 0xFFFF )
-            dt -= 0xFFFF;
 
+    unsigned int count = svm_map_count(map);
 
-        if (getenv("DEBUG") != NULL)
-        {
-            printf("\tCopying from: %04x Copying-to %04X\n", sc, dt);
-        }
+    if (getenv("DEBUG") != NULL)
+        printf("MAP_COUNT(Map:%d) -> %u\n", map_reg, count);
 
-        svm->code[dt] = svm->code[sc];
-    }
+    REGISTER_SET_INTEGER(svm, reg, count);
 
     /* handle the next instruction */
     svm->ip += 1;
 }
 
+
 /**
- * Push the contents of a given register onto the stack.
+ * Free a hash-map, after which its handle is invalid until it is reused
+ * by MAP_NEW.
  */
-void op_stack_push(struct svm *svm)
+void op_map_free(struct svm *svm)
 {
-    /* get the register to push */
-    unsigned int reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
+    /* get the register number with the handle */
+    unsigned int map_reg = next_byte(svm);
+    BOUNDS_TEST_REGISTER(map_reg);
 
-    /* Get the value we're to store. */
-    int val = get_int_reg(svm, reg);
+    svm_map_t *map = map_handle(svm, map_reg);
+    if (!map)
+        return;
 
     if (getenv("DEBUG") != NULL)
-        printf("PUSH(Register %d [=%04x])\n", reg, val);
-
-    /* store it */
-    svm->SP += 1;
-    svm->stack[svm->SP] = val;
-
-    /**
-     * Ensure the stack hasn't overflown.
-     */
-    int sp_size = sizeof(svm->stack) / sizeof(svm->stack[0]);
-    if (svm->SP >= sp_size)
-        svm_default_error_handler(svm, "stack overflow - stack is full");
+        printf("MAP_FREE(Map:%d)\n", map_reg);
 
+    svm_map_free(map);
+    svm->maps[get_int_reg(svm, map_reg) - 1] = NULL;
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1092,33 +3386,21 @@ void op_stack_push(struct svm *svm)
 
 
 /**
- * Pop the topmost entry from the stack into the given register.
+ * Call a native function, registered by the host, with the arguments
+ * held in the registers from the second register onwards, storing its
+ * results in the registers from the first onwards.
  */
-void op_stack_pop(struct svm *svm)
+void op_call_native(struct svm *svm)
 {
-    /* get the register to pop */
-    unsigned int reg = next_byte(svm);
-    BOUNDS_TEST_REGISTER(reg);
-
-    /* ensure we're not outside the stack. */
-    if (svm->SP <= 0)
-        svm_default_error_handler(svm, "stack overflow - stack is empty");
-
-    /* Get the value from the stack. */
-    int val = svm->stack[svm->SP];
-    svm->SP -= 1;
+    unsigned int id = next_byte(svm);
+    unsigned int result = next_byte(svm);
+    unsigned int first = next_byte(svm);
 
     if (getenv("DEBUG") != NULL)
-        printf("POP(Register %d) => %04x\n", reg, val);
-
-
-    /* if the register stores a string .. free it */
-    if ((svm->registers[reg].type == STRING) && (svm->registers[reg].content.string))
-        free(svm->registers[reg].content.string);
-
-    svm->registers[reg].content.integer = val;
-    svm->registers[reg].type = INTEGER;
+        printf("CALL_NATIVE(%u, Result:%u, Arguments:%u)\n", id, result, first);
 
+    if (!svm_native_call(svm, id, result, first, 1))
+        return;
 
     /* handle the next instruction */
     svm->ip += 1;
@@ -1126,66 +3408,93 @@ void op_stack_pop(struct svm *svm)
 
 
 /**
- * Return from a call - by popping the return address from the stack
- * and jumping to it.
+ * Call a native function for each of a number of sets of arguments, in
+ * consecutive registers, with a single transition into the host - the
+ * results of each are likewise stored consecutively.
  */
-void op_stack_ret(struct svm *svm)
+void op_call_native_batch(struct svm *svm)
 {
-    /* ensure we're not outside the stack. */
-    if (svm->SP <= 0)
-        svm_default_error_handler(svm, "stack overflow - stack is empty");
-
-    /* Get the value from the stack. */
-    int val = svm->stack[svm->SP];
-    svm->SP -= 1;
+    unsigned int id = next_byte(svm);
+    unsigned int result = next_byte(svm);
+    unsigned int first = next_byte(svm);
+    unsigned int calls = next_byte(svm);
 
     if (getenv("DEBUG") != NULL)
-        printf("RET() => %04x\n", val);
-
+        printf("CALL_NATIVE_BATCH(%u, Result:%u, Arguments:%u, Calls:%u)\n", id, result,
+               first, calls);
 
-    /* update our instruction pointer. */
-    svm->ip = val;
+    if (!svm_native_call(svm, id, result, first, calls))
+        return;
 
+    /* handle the next instruction */
+    svm->ip += 1;
 }
 
 
 /**
- * Call a routine - push the return address onto the stack.
+ * Run a custom opcode, installed by the host, decoding its operands as
+ * its extension describes them.
  */
-void op_stack_call(struct svm *svm)
+void op_extension(struct svm *svm)
 {
-    /**
-     * Read the two bytes which will build up the destination
-     */
-    unsigned int off1 = next_byte(svm);
-    unsigned int off2 = next_byte(svm);
-
-    /**
-     * Convert to the offset in our code-segment.
-     */
-    int offset = BYTES_TO_ADDR(off1, off2);
+    const svm_extension_t *ext =
+        svm->extensions ? svm->extensions[svm->code[svm->ip]] : NULL;
+    svm_operand_t operands[SVM_EXTENSION_OPERANDS];
 
+    if (!ext)
+    {
+        svm_default_error_handler(svm, "Unknown extension");
+        return;
+    }
 
-    int sp_size = sizeof(svm->stack) / sizeof(svm->stack[0]);
-    svm->SP += 1;
+    for (unsigned int i = 0; ext->operands[i]; i++)
+    {
+        operands[i].string = NULL;
+        operands[i].length = 0;
 
-    if (svm->SP >= sp_size)
-        svm_default_error_handler(svm, "stack overflow - stack is full!");
+        switch (ext->operands[i])
+        {
+        case '2':
+            operands[i].value = next_immediate(svm, 2);
+            break;
+        case '4':
+            operands[i].value = next_immediate(svm, 4);
+            break;
+        case 's':
+            operands[i].length = next_immediate(svm, 2);
+            operands[i].value = 0;
+
+            /* the string is used in place, so it mustn't wrap around */
+            if (svm->ip + 1 + operands[i].length > 0xFFFF)
+            {
+                svm_default_error_handler(svm, "String runs past the end of RAM");
+                return;
+            }
+            operands[i].string = (char *) svm->code + svm->ip + 1;
+            svm->ip += operands[i].length;
+            break;
+        default:
+            operands[i].value = next_byte(svm);
+            if (operands[i].value >= REGISTER_COUNT)
+            {
+                svm_default_error_handler(svm, "Register out of bounds");
+                return;
+            }
+            break;
+        }
+    }
 
-    /**
-     * Now we've got to save the address past this instruction
-     * on the stack so that the "ret(urn)" instruction will go
-     * to the correct place.
-     */
-    svm->stack[svm->SP] = svm->ip + 1;
+    if (getenv("DEBUG") != NULL)
+        printf("EXTENSION(%s)\n", ext->name);
 
-    /**
-     * Now we've saved the return-address we can update the IP
-     */
-    svm->ip = offset;
+    if (!(*ext->handler) (svm, operands))
+        return;
 
+    /* handle the next instruction */
+    svm->ip += 1;
 }
 
+
 /**
  ** End implementation of virtual machine opcodes.
  **
@@ -1215,11 +3524,26 @@ void opcode_init(svm_t * svm)
     svm->opcodes[INT_PRINT] = op_int_print;
     svm->opcodes[INT_TOSTRING] = op_int_tostring;
     svm->opcodes[INT_RANDOM] = op_int_random;
+    svm->opcodes[INT_STORE32] = op_int_store32;
+    svm->opcodes[INT_STORE64] = op_int_store64;
 
     /* jumps */
     svm->opcodes[JUMP_TO] = op_jump_to;
     svm->opcodes[JUMP_NZ] = op_jump_nz;
     svm->opcodes[JUMP_Z] = op_jump_z;
+    svm->opcodes[JUMP_C] = op_jump_c;
+    svm->opcodes[JUMP_NC] = op_jump_nc;
+    svm->opcodes[JUMP_S] = op_jump_s;
+    svm->opcodes[JUMP_NS] = op_jump_ns;
+    svm->opcodes[JUMP_O] = op_jump_o;
+    svm->opcodes[JUMP_NO] = op_jump_no;
+    svm->opcodes[JUMP_LT] = op_jump_lt;
+    svm->opcodes[JUMP_GE] = op_jump_ge;
+    svm->opcodes[JUMP_LE] = op_jump_le;
+    svm->opcodes[JUMP_GT] = op_jump_gt;
+    svm->opcodes[JUMP_BE] = op_jump_be;
+    svm->opcodes[JUMP_A] = op_jump_a;
+    svm->opcodes[DEC_JUMP_NZ] = op_dec_jump_nz;
 
     /* math */
     svm->opcodes[ADD] = op_add;
@@ -1231,6 +3555,47 @@ void opcode_init(svm_t * svm)
     svm->opcodes[OR] = op_or;
     svm->opcodes[INC] = op_inc;
     svm->opcodes[DEC] = op_dec;
+    svm->opcodes[MOD] = op_modulo;
+
+    /* bit operations */
+    svm->opcodes[SHL] = op_shl;
+    svm->opcodes[SHR] = op_shr;
+    svm->opcodes[SAR] = op_sar;
+    svm->opcodes[ROL] = op_rol;
+    svm->opcodes[ROR] = op_ror;
+    svm->opcodes[POPCNT] = op_popcnt;
+    svm->opcodes[CLZ] = op_clz;
+    svm->opcodes[CTZ] = op_ctz;
+
+    /* indirect jumps */
+    svm->opcodes[JUMP_REG] = op_jump_reg;
+    svm->opcodes[CALL_REG] = op_call_reg;
+    svm->opcodes[JUMP_TABLE] = op_jump_table;
+
+    /* arrays */
+    svm->opcodes[VECTOR_MAP] = op_vector_map;
+    svm->opcodes[VECTOR_REDUCE] = op_vector_reduce;
+    svm->opcodes[VECTOR_DOT] = op_vector_dot;
+    svm->opcodes[VECTOR_SCAN] = op_vector_scan;
+    svm->opcodes[VECTOR_SORT] = op_vector_sort;
+    svm->opcodes[VECTOR_SEARCH] = op_vector_search;
+
+    /* hashing */
+    svm->opcodes[HASH_MEMORY] = op_hash_memory;
+    svm->opcodes[HASH_STRING] = op_hash_string;
+
+    /* hash-maps */
+    svm->opcodes[MAP_NEW] = op_map_new;
+    svm->opcodes[MAP_SET] = op_map_set;
+    svm->opcodes[MAP_GET] = op_map_get;
+    svm->opcodes[MAP_DELETE] = op_map_delete;
+    svm->opcodes[MAP_CONTAINS] = op_map_contains;
+    svm->opcodes[MAP_COUNT] = op_map_count;
+    svm->opcodes[MAP_FREE] = op_map_free;
+
+    /* native functions */
+    svm->opcodes[CALL_NATIVE] = op_call_native;
+    svm->opcodes[CALL_NATIVE_BATCH] = op_call_native_batch;
 
     /* strings */
     svm->opcodes[STRING_STORE] = op_string_store;
@@ -1245,6 +3610,12 @@ void opcode_init(svm_t * svm)
     svm->opcodes[CMP_STRING] = op_cmp_string;
     svm->opcodes[IS_STRING] = op_is_string;
     svm->opcodes[IS_INTEGER] = op_is_integer;
+    svm->opcodes[CMP_IMMEDIATE32] = op_cmp_immediate32;
+    svm->opcodes[CMP_IMMEDIATE64] = op_cmp_immediate64;
+    svm->opcodes[CMP_JUMP] = op_cmp_jump;
+    svm->opcodes[CMP_IMMEDIATE_JUMP] = op_cmp_immediate_jump;
+    svm->opcodes[MATCH] = op_match;
+    svm->opcodes[MATCH_REG] = op_match_reg;
 
     /* misc */
     svm->opcodes[NOP] = op_nop;
@@ -1254,10 +3625,33 @@ void opcode_init(svm_t * svm)
     svm->opcodes[PEEK] = op_peek;
     svm->opcodes[POKE] = op_poke;
     svm->opcodes[MEMCPY] = op_memcpy;
+    svm->opcodes[LOAD8] = op_load8;
+    svm->opcodes[LOAD16] = op_load16;
+    svm->opcodes[LOAD32] = op_load32;
+    svm->opcodes[LOAD64] = op_load64;
+    svm->opcodes[STORE8] = op_store8;
+    svm->opcodes[STORE16] = op_store16;
+    svm->opcodes[STORE32] = op_store32;
+    svm->opcodes[STORE64] = op_store64;
+    svm->opcodes[BANK] = op_bank;
+    svm->opcodes[MEMSET] = op_memset;
+    svm->opcodes[MEMCMP] = op_memcmp;
+    svm->opcodes[MEMCHR] = op_memchr;
 
     /* stack */
     svm->opcodes[STACK_PUSH] = op_stack_push;
     svm->opcodes[STACK_POP] = op_stack_pop;
     svm->opcodes[STACK_RET] = op_stack_ret;
     svm->opcodes[STACK_CALL] = op_stack_call;
+    svm->opcodes[STACK_ENTER] = op_stack_enter;
+    svm->opcodes[STACK_LEAVE] = op_stack_leave;
+    svm->opcodes[LOCAL_GET] = op_local_get;
+    svm->opcodes[LOCAL_SET] = op_local_set;
+
+    /* custom opcodes, if any are installed */
+    for (int i = 0; svm->extensions && (i < 256); i++)
+    {
+        if (svm->extensions[i])
+            svm->opcodes[i] = op_extension;
+    }
 }
@@ -43,6 +43,8 @@ enum opcode_values {
     INT_PRINT,
     INT_TOSTRING,
     INT_RANDOM,
+    INT_STORE32,
+    INT_STORE64,
 
     /**
      * Jump operations.
@@ -50,6 +52,19 @@ enum opcode_values {
     JUMP_TO = 0x10,
     JUMP_Z,
     JUMP_NZ,
+    JUMP_C,
+    JUMP_NC,
+    JUMP_S,
+    JUMP_NS,
+    JUMP_O,
+    JUMP_NO,
+    JUMP_LT,
+    JUMP_GE,
+    JUMP_LE,
+    JUMP_GT,
+    JUMP_BE,
+    JUMP_A,
+    DEC_JUMP_NZ,
 
     /**
      * Math operations.
@@ -63,6 +78,7 @@ enum opcode_values {
     DEC,
     AND,
     OR,
+    MOD,
 
     /**
      * String operations.
@@ -81,7 +97,12 @@ enum opcode_values {
     CMP_STRING,
     IS_STRING,
     IS_INTEGER,
-
+    CMP_IMMEDIATE32,
+    CMP_IMMEDIATE64,
+    CMP_JUMP,
+    CMP_IMMEDIATE_JUMP,
+    MATCH,
+    MATCH_REG,
 
     /**
      * Misc.
@@ -95,6 +116,18 @@ enum opcode_values {
     PEEK = 0x60,
     POKE,
     MEMCPY,
+    LOAD8,
+    LOAD16,
+    LOAD32,
+    LOAD64,
+    STORE8,
+    STORE16,
+    STORE32,
+    STORE64,
+    BANK,
+    MEMSET,
+    MEMCMP,
+    MEMCHR,
 
     /**
      * Stack operations.
@@ -102,7 +135,158 @@ enum opcode_values {
     STACK_PUSH = 0x70,
     STACK_POP,
     STACK_RET,
-    STACK_CALL
+    STACK_CALL,
+    STACK_ENTER,
+    STACK_LEAVE,
+    LOCAL_GET,
+    LOCAL_SET,
+
+    /**
+     * Bit operations.
+     */
+    SHL = 0x80,
+    SHR,
+    SAR,
+    ROL,
+    ROR,
+    POPCNT,
+    CLZ,
+    CTZ,
+
+    /**
+     * Indirect jumps.
+     */
+    JUMP_REG = 0x90,
+    CALL_REG,
+    JUMP_TABLE,
+
+    /**
+     * Array operations.
+     */
+    VECTOR_MAP = 0xA0,
+    VECTOR_REDUCE,
+    VECTOR_DOT,
+    VECTOR_SCAN,
+    VECTOR_SORT,
+    VECTOR_SEARCH,
+
+    /**
+     * Hashing.
+     */
+    HASH_MEMORY = 0xB0,
+    HASH_STRING,
+
+    /**
+     * Hash-maps.
+     */
+    MAP_NEW = 0xC0,
+    MAP_SET,
+    MAP_GET,
+    MAP_DELETE,
+    MAP_CONTAINS,
+    MAP_COUNT,
+    MAP_FREE,
+
+    /**
+     * Native function calls.
+     */
+    CALL_NATIVE = 0xD0,
+    CALL_NATIVE_BATCH
+};
+
+
+/**
+ * The conditions which may be tested by a jump.
+ *
+ * The conditional jumps are in this order, starting from JUMP_Z, and the
+ * fused compare-and-jump instructions encode one of these in a byte.
+ *
+ * Each condition is followed by its inverse, so toggling the lowest bit
+ * of a condition inverts it.
+ */
+enum condition_values {
+    COND_Z = 0,                 /* equal */
+    COND_NZ,                    /* not equal */
+    COND_C,                     /* unsigned less than */
+    COND_NC,                    /* unsigned greater than, or equal */
+    COND_S,                     /* negative */
+    COND_NS,                    /* not negative */
+    COND_O,                     /* signed overflow */
+    COND_NO,                    /* no signed overflow */
+    COND_LT,                    /* signed less than */
+    COND_GE,                    /* signed greater than, or equal */
+    COND_LE,                    /* signed less than, or equal */
+    COND_GT,                    /* signed greater than */
+    COND_BE,                    /* unsigned less than, or equal */
+    COND_A,                     /* unsigned greater than */
+    COND_MAX
+};
+
+
+
+/**
+ * The loads and stores are followed by a register, the base and index
+ * registers, a byte describing the address, and a signed 16-bit
+ * displacement:
+ *
+ *    address = base + (index << scale) + displacement
+ *
+ * The bits of the address-mode byte are described here; any others must
+ * be zero.
+ */
+enum address_mode_values {
+    ADDRESS_SCALE = 0x03,       /* the index is shifted left by this many bits */
+    ADDRESS_INDEX = 0x04,       /* the index register is used */
+};
+
+
+
+/**
+ * The array operations are followed by a byte which holds the width of
+ * their elements in its lowest two bits, and for VECTOR_MAP and
+ * VECTOR_REDUCE the operation to perform in the bits above those - or
+ * for VECTOR_SORT and VECTOR_SEARCH the order of the array.
+ */
+enum vector_width_values {
+    VECTOR_8 = 0,
+    VECTOR_16,
+    VECTOR_32
+};
+
+enum vector_operation_values {
+    VECTOR_ADD = 0,
+    VECTOR_SUB,
+    VECTOR_MUL,
+    VECTOR_AND,
+    VECTOR_OR,
+    VECTOR_XOR,
+    VECTOR_OPERATION_MAX
+};
+
+enum vector_reduction_values {
+    VECTOR_SUM = 0,
+    VECTOR_MIN,
+    VECTOR_MAX,
+    VECTOR_REDUCTION_MAX
+};
+
+enum vector_order_values {
+    VECTOR_DESCENDING = 0x01,   /* largest first, rather than smallest */
+    VECTOR_PAIRS = 0x02,        /* each element is followed by a value */
+    VECTOR_ORDER_MAX = 0x04
+};
+
+
+
+/**
+ * The hashing operations are followed by a byte which selects the
+ * algorithm to use.
+ */
+enum hash_values {
+    HASH_CRC32C = 0,
+    HASH_XXH64,
+    HASH_ADLER32,
+    HASH_MAX
 };
 
 
@@ -113,11 +297,26 @@ void op_int_store(struct svm *in);
 void op_int_print(struct svm *in);
 void op_int_tostring(struct svm *in);
 void op_int_random(struct svm *in);
+void op_int_store32(struct svm *in);
+void op_int_store64(struct svm *in);
 
 /* 0x10 - 0x1F */
 void op_jump_to(struct svm *in);
 void op_jump_z(struct svm *in);
 void op_jump_nz(struct svm *in);
+void op_jump_c(struct svm *in);
+void op_jump_nc(struct svm *in);
+void op_jump_s(struct svm *in);
+void op_jump_ns(struct svm *in);
+void op_jump_o(struct svm *in);
+void op_jump_no(struct svm *in);
+void op_jump_lt(struct svm *in);
+void op_jump_ge(struct svm *in);
+void op_jump_le(struct svm *in);
+void op_jump_gt(struct svm *in);
+void op_jump_be(struct svm *in);
+void op_jump_a(struct svm *in);
+void op_dec_jump_nz(struct svm *in);
 
 /* 0x20 - 0x2F */
 void op_xor(struct svm *in);
@@ -129,6 +328,7 @@ void op_mul(struct svm *in);
 void op_div(struct svm *in);
 void op_inc(struct svm *in);
 void op_dec(struct svm *in);
+void op_modulo(struct svm *in);
 
 /* 0x30 - 0x3F */
 void op_string_store(struct svm *in);
@@ -143,6 +343,12 @@ void op_cmp_immediate(struct svm *in);
 void op_cmp_string(struct svm *in);
 void op_is_string(struct svm *in);
 void op_is_integer(struct svm *in);
+void op_cmp_immediate32(struct svm *in);
+void op_cmp_immediate64(struct svm *in);
+void op_cmp_jump(struct svm *in);
+void op_cmp_immediate_jump(struct svm *in);
+void op_match(struct svm *in);
+void op_match_reg(struct svm *in);
 
 /* 0x50 - 0x5F */
 void op_nop(struct svm *in);
@@ -153,6 +359,18 @@ void op_reg_store(struct svm *in);
 void op_peek(struct svm *in);
 void op_poke(struct svm *in);
 void op_memcpy(struct svm *in);
+void op_load8(struct svm *in);
+void op_load16(struct svm *in);
+void op_load32(struct svm *in);
+void op_load64(struct svm *in);
+void op_store8(struct svm *in);
+void op_store16(struct svm *in);
+void op_store32(struct svm *in);
+void op_store64(struct svm *in);
+void op_bank(struct svm *in);
+void op_memset(struct svm *in);
+void op_memcmp(struct svm *in);
+void op_memchr(struct svm *in);
 
 
 /* 0x70 - 0x7F */
@@ -160,6 +378,56 @@ void op_stack_push(struct svm *in);
 void op_stack_pop(struct svm *in);
 void op_stack_ret(struct svm *in);
 void op_stack_call(struct svm *in);
+void op_stack_enter(struct svm *in);
+void op_stack_leave(struct svm *in);
+void op_local_get(struct svm *in);
+void op_local_set(struct svm *in);
+
+/* 0x80 - 0x8F */
+void op_shl(struct svm *in);
+void op_shr(struct svm *in);
+void op_sar(struct svm *in);
+void op_rol(struct svm *in);
+void op_ror(struct svm *in);
+void op_popcnt(struct svm *in);
+void op_clz(struct svm *in);
+void op_ctz(struct svm *in);
+
+/* 0x90 - 0x9F */
+void op_jump_reg(struct svm *in);
+void op_call_reg(struct svm *in);
+void op_jump_table(struct svm *in);
+
+/* 0xA0 - 0xAF */
+void op_vector_map(struct svm *in);
+void op_vector_reduce(struct svm *in);
+void op_vector_dot(struct svm *in);
+void op_vector_scan(struct svm *in);
+void op_vector_sort(struct svm *in);
+void op_vector_search(struct svm *in);
+
+/* 0xB0 - 0xBF */
+void op_hash_memory(struct svm *in);
+void op_hash_string(struct svm *in);
+
+/* 0xC0 - 0xCF */
+void op_map_new(struct svm *in);
+void op_map_set(struct svm *in);
+void op_map_get(struct svm *in);
+void op_map_delete(struct svm *in);
+void op_map_contains(struct svm *in);
+void op_map_count(struct svm *in);
+void op_map_free(struct svm *in);
+
+/* 0xD0 - 0xDF */
+void op_call_native(struct svm *in);
+void op_call_native_batch(struct svm *in);
+
+/* Custom opcodes, described by an extension */
+void op_extension(struct svm *in);
+
+/* Anything else */
+void op_unknown(struct svm *in);
 
 
 
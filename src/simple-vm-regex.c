@@ -0,0 +1,1732 @@
+/**
+ * simple-vm-regex.c - Regular expressions for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "simple-vm-regex.h"
+
+
+
+/**
+ * Limits upon the patterns we'll compile.
+ *
+ * Nesting is limited so that compiling can't exhaust the C stack, and
+ * the size of the program so that counted repetition can't make it
+ * enormous.
+ */
+#define REGEX_MAX_DEPTH   256
+#define REGEX_MAX_INSNS   16384
+#define REGEX_MAX_REPEAT  1000
+
+
+/**
+ * The largest number of states the DFA for a pattern may have, each of
+ * which takes a little over 1k.  If more are needed the pattern is
+ * matched without it.
+ */
+#define DFA_MAX_STATES    256
+
+
+/**
+ * A set of bytes, such as a character class.
+ */
+typedef uint32_t byte_set_t[8];
+
+#define SET_ADD(set, c) ((set)[(c) >> 5] |= (1u << ((c) & 31)))
+#define SET_HAS(set, c) ((set)[(c) >> 5] & (1u << ((c) & 31)))
+
+
+/**
+ * A pattern is first parsed into a tree of these nodes.
+ *
+ * The children of a sequence, an alternation, a group, or a repetition
+ * are linked through `next`, starting at `child`.  Nodes are referred to
+ * by their index, as the array holding them grows while parsing.
+ */
+enum node_types {
+    NODE_CHAR,
+    NODE_ANY,
+    NODE_CLASS,
+    NODE_BOL,
+    NODE_EOL,
+    NODE_WORD_BOUNDARY,
+    NODE_NOT_WORD_BOUNDARY,
+    NODE_SEQUENCE,
+    NODE_ALTERNATION,
+    NODE_GROUP,
+    NODE_REPEAT
+};
+
+typedef struct node {
+    int type;
+    int child;
+    int next;
+    int value;                  /* byte, class, or group number */
+    int min;
+    int max;                    /* -1 if unbounded */
+    _Bool greedy;
+} node_t;
+
+
+/**
+ * The tree is then turned into a program of these instructions.
+ *
+ * CHAR, ANY, and CLASS consume a byte of the subject.  SPLIT continues
+ * at both `x` and `y`, preferring `x`, and SAVE records the current
+ * offset in capture slot `x`.
+ */
+enum regex_ops {
+    RE_CHAR,
+    RE_ANY,
+    RE_CLASS,
+    RE_MATCH,
+    RE_JMP,
+    RE_SPLIT,
+    RE_SAVE,
+    RE_BOL,
+    RE_EOL,
+    RE_WORD_BOUNDARY,
+    RE_NOT_WORD_BOUNDARY
+};
+
+typedef struct insn {
+    unsigned char op;
+    unsigned char byte;
+    int x;
+    int y;
+} insn_t;
+
+
+/**
+ * The threads which are alive at one offset of the subject, in order of
+ * priority, each with its capture slots.
+ */
+typedef struct thread_list {
+    int *pc;
+    int *captures;
+    unsigned int count;
+} thread_list_t;
+
+
+/**
+ * What surrounds an offset of the subject, which decides whether the
+ * anchors match there.
+ */
+enum position_flags {
+    AT_START = 0x01,
+    AT_END = 0x02,
+    WORD_BEFORE = 0x04,
+    WORD_AFTER = 0x08
+};
+
+
+/**
+ * A state of the DFA, which stands for a set of threads.
+ *
+ * The `kernel` is the set of instructions the threads were started at,
+ * which identifies the state, and `threads` those which consume a byte
+ * that they reach.  The transitions to other states are filled in as
+ * they're needed.
+ */
+typedef struct dfa_state {
+    int *kernel;
+    unsigned int kernel_count;
+    int *threads;
+    unsigned int thread_count;
+    _Bool start;
+    _Bool accepting;
+    signed char accepting_at_end;       /* -1 until known */
+    int next[256];
+} dfa_state_t;
+
+
+/**
+ * An entry on the stack used while following the instructions which
+ * don't consume anything - either a path still to be followed, or a
+ * capture slot to restore once one has been.
+ */
+typedef struct frame {
+    int pc;
+    int slot;                   /* -1 to follow `pc` */
+    int value;
+} frame_t;
+
+
+struct svm_regex {
+    char *pattern;
+    unsigned int length;
+
+    insn_t *code;
+    unsigned int count;
+    byte_set_t *classes;
+    unsigned int groups;
+
+    /**
+     * Can a match only begin at the start of the subject?
+     */
+    _Bool anchored;
+
+    /**
+     * If the pattern can't match the empty string, the bytes a match
+     * may begin with - and that byte, if there is just one.
+     */
+    _Bool skip;
+    byte_set_t first;
+    int first_byte;
+
+    /**
+     * If the pattern is a plain string, that string.
+     */
+    char *literal;
+    unsigned int literal_length;
+
+    /**
+     * Memory used while matching, so none need be allocated.
+     */
+    thread_list_t lists[2];
+    unsigned int *marks;
+    unsigned int generation;
+    int *current;
+    frame_t *stack;
+
+    /**
+     * The DFA, which is used to find whether there is a match unless
+     * the pattern has word boundaries, or needs too many states.
+     */
+    _Bool dfa;
+    dfa_state_t *states;
+    unsigned int state_count;
+    unsigned int state_slots;
+    int idle;
+    int *kernel;
+};
+
+
+/**
+ * The state of the compiler.
+ */
+typedef struct compiler {
+    const unsigned char *p;
+    const unsigned char *end;
+    int depth;
+    const char *error;
+
+    node_t *nodes;
+    unsigned int node_count;
+    unsigned int node_slots;
+
+    byte_set_t *classes;
+    unsigned int class_count;
+    unsigned int class_slots;
+
+    unsigned int groups;
+
+    insn_t *code;
+    unsigned int count;
+    unsigned int slots;
+    unsigned int visits;
+} compiler_t;
+
+
+static int parse_alternation(compiler_t * c);
+static void dfa_free(svm_regex_t * re);
+
+
+
+/**
+ * Is the given byte part of a word, for \w and \b?
+ */
+static _Bool is_word(int c)
+{
+    return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+        ((c >= '0') && (c <= '9')) || (c == '_');
+}
+
+
+/**
+ * Grow an array, as needed, so that it has room for one more entry.
+ *
+ * Returns false if memory could not be allocated.
+ */
+static _Bool reserve(void **array, unsigned int *slots, unsigned int count, size_t size)
+{
+    if (count < *slots)
+        return true;
+
+    unsigned int grown = *slots ? *slots * 2 : 16;
+    void *tmp = realloc(*array, grown * size);
+    if (!tmp)
+        return false;
+
+    *array = tmp;
+    *slots = grown;
+    return true;
+}
+
+
+/**
+ * Add a node of the given type to the tree, returning its index, or -1
+ * if memory could not be allocated.
+ */
+static int new_node(compiler_t * c, int type, int value)
+{
+    if (!reserve((void **) &c->nodes, &c->node_slots, c->node_count, sizeof(node_t)))
+        return -1;
+
+    node_t *n = &c->nodes[c->node_count];
+    memset(n, '\0', sizeof(node_t));
+    n->type = type;
+    n->child = -1;
+    n->next = -1;
+    n->value = value;
+    return (int) c->node_count++;
+}
+
+
+/**
+ * Add an empty character class, returning its index, or -1 if memory
+ * could not be allocated.
+ */
+static int new_class(compiler_t * c)
+{
+    if (!reserve((void **) &c->classes, &c->class_slots, c->class_count,
+                 sizeof(byte_set_t)))
+        return -1;
+
+    memset(c->classes[c->class_count], '\0', sizeof(byte_set_t));
+    return (int) c->class_count++;
+}
+
+
+/**
+ * Record the first error we find.
+ */
+static int fail(compiler_t * c, const char *error)
+{
+    if (!c->error)
+        c->error = error;
+    return -1;
+}
+
+
+/**
+ * Add the bytes matched by one of the escapes \d, \w, or \s - or their
+ * opposites, when `letter` is in upper-case - to the given set.
+ */
+static void add_shorthand(byte_set_t set, int letter)
+{
+    int lower = letter | 0x20;
+
+    for (int b = 0; b < 256; b++)
+    {
+        _Bool in = (lower == 'd') ? ((b >= '0') && (b <= '9'))
+            : (lower == 'w') ? is_word(b)
+            : ((b == ' ') || ((b >= '\t') && (b <= '\r')));
+
+        if (in != (letter != lower))
+            SET_ADD(set, b);
+    }
+}
+
+
+/**
+ * Parse the value of a hexadecimal digit, returning -1 if it isn't one.
+ */
+static int hex_digit(int c)
+{
+    if ((c >= '0') && (c <= '9'))
+        return c - '0';
+    if (((c | 0x20) >= 'a') && ((c | 0x20) <= 'f'))
+        return (c | 0x20) - 'a' + 10;
+    return -1;
+}
+
+
+/**
+ * Parse an escape, after its backslash.
+ *
+ * Returns 0 having stored the byte it stands for, 1 having added the
+ * bytes of a shorthand class to `set`, or -1 on error.
+ */
+static int parse_escape(compiler_t * c, byte_set_t set, int *byte)
+{
+    if (c->p >= c->end)
+        return fail(c, "Regular expression ends with \\");
+
+    int e = *c->p++;
+
+    switch (e)
+    {
+    case 'd':
+    case 'D':
+    case 'w':
+    case 'W':
+    case 's':
+    case 'S':
+        add_shorthand(set, e);
+        return 1;
+    case 'n':
+        *byte = '\n';
+        return 0;
+    case 't':
+        *byte = '\t';
+        return 0;
+    case 'r':
+        *byte = '\r';
+        return 0;
+    case 'f':
+        *byte = '\f';
+        return 0;
+    case 'v':
+        *byte = '\v';
+        return 0;
+    case '0':
+        *byte = 0;
+        return 0;
+    case 'x':
+        if ((c->end - c->p < 2) || (hex_digit(c->p[0]) < 0) || (hex_digit(c->p[1]) < 0))
+            return fail(c, "Regular expression has an invalid \\x escape");
+        *byte = (hex_digit(c->p[0]) * 16) + hex_digit(c->p[1]);
+        c->p += 2;
+        return 0;
+    }
+
+    /**
+     * Any other letter or digit is reserved, but punctuation stands for
+     * itself.
+     */
+    if (is_word(e))
+        return fail(c, "Regular expression has an unknown escape");
+
+    *byte = e;
+    return 0;
+}
+
+
+/**
+ * Parse a character class, after its opening bracket.
+ */
+static int parse_class(compiler_t * c)
+{
+    int class = new_class(c);
+    if (class < 0)
+        return -1;
+
+    _Bool negated = false;
+    if ((c->p < c->end) && (*c->p == '^'))
+    {
+        negated = true;
+        c->p++;
+    }
+
+    /**
+     * A closing bracket at the very start is part of the class.
+     */
+    _Bool start = true;
+    byte_set_t set;
+    memset(set, '\0', sizeof(set));
+
+    while ((c->p < c->end) && ((*c->p != ']') || start))
+    {
+        start = false;
+
+        int low = *c->p++;
+        if (low == '\\')
+        {
+            int kind = parse_escape(c, set, &low);
+            if (kind < 0)
+                return -1;
+            if (kind == 1)
+                continue;
+        }
+
+        int high = low;
+        if ((c->end - c->p >= 2) && (c->p[0] == '-') && (c->p[1] != ']'))
+        {
+            c->p++;
+            high = *c->p++;
+
+            if (high == '\\')
+            {
+                byte_set_t ignored = { 0 };
+                if (parse_escape(c, ignored, &high) != 0)
+                    return fail(c, "Regular expression has an invalid range");
+            }
+            if (high < low)
+                return fail(c, "Regular expression has an invalid range");
+        }
+
+        for (int b = low; b <= high; b++)
+            SET_ADD(set, b);
+    }
+
+    if (c->p >= c->end)
+        return fail(c, "Regular expression has an unterminated [");
+    c->p++;
+
+    for (int i = 0; i < 8; i++)
+        c->classes[class][i] = negated ? ~set[i] : set[i];
+
+    return new_node(c, NODE_CLASS, class);
+}
+
+
+/**
+ * Parse a decimal number, returning -1 if there isn't one, or -2 if it
+ * is larger than REGEX_MAX_REPEAT.
+ */
+static int parse_number(compiler_t * c)
+{
+    int value = -1;
+
+    while ((c->p < c->end) && (*c->p >= '0') && (*c->p <= '9'))
+    {
+        if (value <= REGEX_MAX_REPEAT)
+            value = ((value < 0) ? 0 : value * 10) + (*c->p - '0');
+        c->p++;
+    }
+    return (value > REGEX_MAX_REPEAT) ? -2 : value;
+}
+
+
+/**
+ * Parse a quantifier, if there is one, storing its bounds.
+ *
+ * Returns 1 if one was found, 0 if not, or -1 on error.  As in Perl, a
+ * brace which doesn't begin a valid count is just a brace.
+ */
+static int parse_quantifier(compiler_t * c, int *min, int *max)
+{
+    if (c->p >= c->end)
+        return 0;
+
+    switch (*c->p)
+    {
+    case '*':
+        *min = 0;
+        *max = -1;
+        break;
+    case '+':
+        *min = 1;
+        *max = -1;
+        break;
+    case '?':
+        *min = 0;
+        *max = 1;
+        break;
+    case '{':
+    {
+        const unsigned char *brace = c->p++;
+
+        int low = parse_number(c);
+        int high = low;
+        if ((low != -1) && (c->p < c->end) && (*c->p == ','))
+        {
+            c->p++;
+            high = parse_number(c);
+        }
+
+        if ((low == -1) || (c->p >= c->end) || (*c->p != '}'))
+        {
+            c->p = brace;
+            return 0;
+        }
+
+        if ((low == -2) || (high == -2) || ((high >= 0) && (high < low)))
+            return fail(c, "Regular expression has an invalid count");
+
+        *min = low;
+        *max = high;
+        break;
+    }
+    default:
+        return 0;
+    }
+
+    c->p++;
+    return 1;
+}
+
+
+/**
+ * Parse a single item - a byte, class, anchor, or group.
+ */
+static int parse_atom(compiler_t * c)
+{
+    int byte = *c->p++;
+
+    switch (byte)
+    {
+    case '(':
+    {
+        _Bool capture = true;
+
+        if ((c->p < c->end) && (*c->p == '?'))
+        {
+            if ((c->end - c->p < 2) || (c->p[1] != ':'))
+                return fail(c, "Regular expression has an unknown group type");
+            capture = false;
+            c->p += 2;
+        }
+
+        if (++c->depth > REGEX_MAX_DEPTH)
+            return fail(c, "Regular expression is nested too deeply");
+
+        unsigned int group = 0;
+        if (capture)
+        {
+            if (c->groups >= SVM_REGEX_GROUPS)
+                return fail(c, "Regular expression has too many groups");
+            group = ++c->groups;
+        }
+
+        int inner = parse_alternation(c);
+        if (inner < 0)
+            return -1;
+
+        if ((c->p >= c->end) || (*c->p != ')'))
+            return fail(c, "Regular expression has an unterminated (");
+        c->p++;
+        c->depth--;
+
+        if (!capture)
+            return inner;
+
+        int n = new_node(c, NODE_GROUP, group);
+        if (n >= 0)
+            c->nodes[n].child = inner;
+        return n;
+    }
+    case '[':
+        return parse_class(c);
+    case '.':
+        return new_node(c, NODE_ANY, 0);
+    case '^':
+        return new_node(c, NODE_BOL, 0);
+    case '$':
+        return new_node(c, NODE_EOL, 0);
+    case '*':
+    case '+':
+    case '?':
+        return fail(c, "Regular expression has nothing to repeat");
+    case '{':
+    {
+        int min, max;
+
+        c->p--;
+        if (parse_quantifier(c, &min, &max) != 0)
+            return fail(c, "Regular expression has nothing to repeat");
+        c->p++;
+        return new_node(c, NODE_CHAR, byte);
+    }
+    case '\\':
+        if ((c->p < c->end) && ((*c->p == 'b') || (*c->p == 'B')))
+            return new_node(c, (*c->p++ == 'b') ? NODE_WORD_BOUNDARY :
+                            NODE_NOT_WORD_BOUNDARY, 0);
+        else
+        {
+            byte_set_t set;
+            memset(set, '\0', sizeof(set));
+
+            int kind = parse_escape(c, set, &byte);
+            if (kind <= 0)
+                return (kind < 0) ? -1 : new_node(c, NODE_CHAR, byte);
+
+            int class = new_class(c);
+            if (class < 0)
+                return -1;
+            memcpy(c->classes[class], set, sizeof(byte_set_t));
+            return new_node(c, NODE_CLASS, class);
+        }
+    }
+
+    return new_node(c, NODE_CHAR, byte);
+}
+
+
+/**
+ * Parse an item followed by an optional quantifier.
+ */
+static int parse_repeat(compiler_t * c)
+{
+    int atom = parse_atom(c);
+    if (atom < 0)
+        return -1;
+
+    int min, max;
+    int found = parse_quantifier(c, &min, &max);
+    if (found <= 0)
+        return (found < 0) ? -1 : atom;
+
+    _Bool greedy = true;
+    if ((c->p < c->end) && (*c->p == '?'))
+    {
+        greedy = false;
+        c->p++;
+    }
+
+    int ignored;
+    found = parse_quantifier(c, &ignored, &ignored);
+    if (found != 0)
+        return fail(c, "Regular expression has a repeated quantifier");
+
+    int n = new_node(c, NODE_REPEAT, 0);
+    if (n < 0)
+        return -1;
+
+    c->nodes[n].child = atom;
+    c->nodes[n].min = min;
+    c->nodes[n].max = max;
+    c->nodes[n].greedy = greedy;
+    return n;
+}
+
+
+/**
+ * Parse a sequence of items, which ends at a "|" or ")".
+ */
+static int parse_sequence(compiler_t * c)
+{
+    int sequence = new_node(c, NODE_SEQUENCE, 0);
+    int last = -1;
+
+    while ((sequence >= 0) && (c->p < c->end) && (*c->p != '|') && (*c->p != ')'))
+    {
+        int n = parse_repeat(c);
+        if (n < 0)
+            return -1;
+
+        if (last < 0)
+            c->nodes[sequence].child = n;
+        else
+            c->nodes[last].next = n;
+        last = n;
+    }
+    return sequence;
+}
+
+
+/**
+ * Parse one or more sequences, separated by "|".
+ */
+static int parse_alternation(compiler_t * c)
+{
+    int first = parse_sequence(c);
+    if ((first < 0) || (c->p >= c->end) || (*c->p != '|'))
+        return first;
+
+    int alternation = new_node(c, NODE_ALTERNATION, 0);
+    if (alternation < 0)
+        return -1;
+
+    c->nodes[alternation].child = first;
+
+    int last = first;
+    while ((c->p < c->end) && (*c->p == '|'))
+    {
+        c->p++;
+
+        int n = parse_sequence(c);
+        if (n < 0)
+            return -1;
+
+        c->nodes[last].next = n;
+        last = n;
+    }
+    return alternation;
+}
+
+
+/**
+ * Append an instruction to the program, returning its index, or -1 if
+ * the program is too large.
+ */
+static int emit(compiler_t * c, int op, int byte, int x, int y)
+{
+    if (c->count >= REGEX_MAX_INSNS)
+        return fail(c, "Regular expression is too large");
+
+    if (!reserve((void **) &c->code, &c->slots, c->count, sizeof(insn_t)))
+        return -1;
+
+    c->code[c->count].op = op;
+    c->code[c->count].byte = byte;
+    c->code[c->count].x = x;
+    c->code[c->count].y = y;
+    return (int) c->count++;
+}
+
+
+/**
+ * Generate the instructions for the given node.
+ */
+static _Bool generate(compiler_t * c, int index)
+{
+    const node_t n = c->nodes[index];
+
+    /**
+     * Repeating something which generates nothing, such as "(?:)", costs
+     * time without making the program any larger.
+     */
+    if (++c->visits > REGEX_MAX_INSNS * 4)
+    {
+        fail(c, "Regular expression is too large");
+        return false;
+    }
+
+    switch (n.type)
+    {
+    case NODE_CHAR:
+        return emit(c, RE_CHAR, n.value, 0, 0) >= 0;
+    case NODE_ANY:
+        return emit(c, RE_ANY, 0, 0, 0) >= 0;
+    case NODE_CLASS:
+        return emit(c, RE_CLASS, 0, n.value, 0) >= 0;
+    case NODE_BOL:
+        return emit(c, RE_BOL, 0, 0, 0) >= 0;
+    case NODE_EOL:
+        return emit(c, RE_EOL, 0, 0, 0) >= 0;
+    case NODE_WORD_BOUNDARY:
+        return emit(c, RE_WORD_BOUNDARY, 0, 0, 0) >= 0;
+    case NODE_NOT_WORD_BOUNDARY:
+        return emit(c, RE_NOT_WORD_BOUNDARY, 0, 0, 0) >= 0;
+
+    case NODE_SEQUENCE:
+        for (int i = n.child; i >= 0; i = c->nodes[i].next)
+        {
+            if (!generate(c, i))
+                return false;
+        }
+        return true;
+
+    case NODE_GROUP:
+        return (emit(c, RE_SAVE, 0, n.value * 2, 0) >= 0) && generate(c, n.child) &&
+            (emit(c, RE_SAVE, 0, (n.value * 2) + 1, 0) >= 0);
+
+    case NODE_ALTERNATION:
+    {
+        /**
+         *     SPLIT L1, L2
+         * L1: first
+         *     JMP end
+         * L2: SPLIT L3, L4
+         * L3: second
+         *     JMP end
+         * L4: last
+         * end:
+         *
+         * The jumps to the end are chained through their targets until
+         * we know where it is.
+         */
+        int jumps = -1;
+
+        for (int i = n.child; i >= 0; i = c->nodes[i].next)
+        {
+            if (c->nodes[i].next < 0)
+            {
+                if (!generate(c, i))
+                    return false;
+                break;
+            }
+
+            int split = emit(c, RE_SPLIT, 0, 0, 0);
+            if ((split < 0) || !generate(c, i))
+                return false;
+
+            int jump = emit(c, RE_JMP, 0, jumps, 0);
+            if (jump < 0)
+                return false;
+            jumps = jump;
+
+            c->code[split].x = split + 1;
+            c->code[split].y = (int) c->count;
+        }
+
+        while (jumps >= 0)
+        {
+            int previous = c->code[jumps].x;
+            c->code[jumps].x = (int) c->count;
+            jumps = previous;
+        }
+        return true;
+    }
+
+    case NODE_REPEAT:
+    {
+        /**
+         * The item is repeated its minimum number of times, and is then
+         * followed by a loop if there's no maximum, or by optional copies
+         * of it if there is.  "x+" becomes a single copy followed by a
+         * loop back to it.
+         */
+        int copies = n.min;
+        if ((n.max < 0) && (n.min > 0))
+            copies -= 1;
+
+        for (int i = 0; i < copies; i++)
+        {
+            if (!generate(c, n.child))
+                return false;
+        }
+
+        if (n.max < 0)
+        {
+            int loop = (int) c->count;
+            int split;
+
+            if (n.min > 0)
+            {
+                if (!generate(c, n.child) || ((split = emit(c, RE_SPLIT, 0, 0, 0)) < 0))
+                    return false;
+                c->code[split].x = n.greedy ? loop : split + 1;
+                c->code[split].y = n.greedy ? split + 1 : loop;
+            }
+            else
+            {
+                if (((split = emit(c, RE_SPLIT, 0, 0, 0)) < 0) || !generate(c, n.child) ||
+                    (emit(c, RE_JMP, 0, split, 0) < 0))
+                    return false;
+                c->code[split].x = n.greedy ? split + 1 : (int) c->count;
+                c->code[split].y = n.greedy ? (int) c->count : split + 1;
+            }
+            return true;
+        }
+
+        /**
+         * Each optional copy skips to the end if it isn't taken; the
+         * splits are chained through `y` until we know where that is.
+         */
+        int splits = -1;
+
+        for (int i = n.min; i < n.max; i++)
+        {
+            int split = emit(c, RE_SPLIT, 0, 0, splits);
+            if ((split < 0) || !generate(c, n.child))
+                return false;
+            splits = split;
+        }
+
+        while (splits >= 0)
+        {
+            int previous = c->code[splits].y;
+            c->code[splits].x = n.greedy ? splits + 1 : (int) c->count;
+            c->code[splits].y = n.greedy ? (int) c->count : splits + 1;
+            splits = previous;
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+
+/**
+ * Can a match of the given node only begin at the start of the subject?
+ */
+static _Bool anchored(const compiler_t * c, int index)
+{
+    const node_t *n = &c->nodes[index];
+
+    switch (n->type)
+    {
+    case NODE_BOL:
+        return true;
+    case NODE_GROUP:
+        return anchored(c, n->child);
+    case NODE_REPEAT:
+        return (n->min > 0) && anchored(c, n->child);
+    case NODE_SEQUENCE:
+        return (n->child >= 0) && anchored(c, n->child);
+    case NODE_ALTERNATION:
+        for (int i = n->child; i >= 0; i = c->nodes[i].next)
+        {
+            if (!anchored(c, i))
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Add the bytes a match of the given node might begin with to `set`,
+ * returning true if it might also match the empty string.
+ */
+static _Bool first_bytes(const compiler_t * c, int index, byte_set_t set)
+{
+    const node_t *n = &c->nodes[index];
+
+    switch (n->type)
+    {
+    case NODE_CHAR:
+        SET_ADD(set, n->value);
+        return false;
+    case NODE_ANY:
+        for (int b = 0; b < 256; b++)
+        {
+            if (b != '\n')
+                SET_ADD(set, b);
+        }
+        return false;
+    case NODE_CLASS:
+        for (int i = 0; i < 8; i++)
+            set[i] |= c->classes[n->value][i];
+        return false;
+    case NODE_GROUP:
+        return first_bytes(c, n->child, set);
+    case NODE_REPEAT:
+        return first_bytes(c, n->child, set) || (n->min == 0);
+    case NODE_SEQUENCE:
+        for (int i = n->child; i >= 0; i = c->nodes[i].next)
+        {
+            if (!first_bytes(c, i, set))
+                return false;
+        }
+        return true;
+    case NODE_ALTERNATION:
+    {
+        _Bool empty = false;
+        for (int i = n->child; i >= 0; i = c->nodes[i].next)
+            empty = first_bytes(c, i, set) || empty;
+        return empty;
+    }
+    }
+
+    /**
+     * Anchors match the empty string.
+     */
+    return true;
+}
+
+
+/**
+ * Free the memory used while compiling.
+ */
+static void compiler_free(compiler_t * c)
+{
+    free(c->nodes);
+    free(c->classes);
+    free(c->code);
+}
+
+
+/**
+ * Compile a pattern.
+ */
+svm_regex_t *svm_regex_compile(const char *pattern, unsigned int length,
+                               const char **error)
+{
+    compiler_t c;
+    memset(&c, '\0', sizeof(compiler_t));
+    c.p = (const unsigned char *) pattern;
+    c.end = c.p + length;
+
+    *error = NULL;
+
+    /**
+     * Parse the pattern, then generate the program:
+     *
+     *     SAVE 0
+     *     pattern
+     *     SAVE 1
+     *     MATCH
+     */
+    int root = parse_alternation(&c);
+    if ((root >= 0) && (c.p < c.end))
+        root = fail(&c, "Regular expression has an unmatched )");
+
+    if ((root < 0) || (emit(&c, RE_SAVE, 0, 0, 0) < 0) || !generate(&c, root) ||
+        (emit(&c, RE_SAVE, 0, 1, 0) < 0) || (emit(&c, RE_MATCH, 0, 0, 0) < 0))
+    {
+        *error = c.error;
+        compiler_free(&c);
+        return NULL;
+    }
+
+    svm_regex_t *re = calloc(1, sizeof(svm_regex_t));
+    if (!re)
+    {
+        compiler_free(&c);
+        return NULL;
+    }
+
+    re->anchored = anchored(&c, root);
+    re->skip = !re->anchored && !first_bytes(&c, root, re->first);
+    re->first_byte = -1;
+
+    unsigned int firsts = 0;
+    for (int b = 0; b < 256; b++)
+    {
+        if (SET_HAS(re->first, b))
+        {
+            firsts += 1;
+            re->first_byte = b;
+        }
+    }
+    if (firsts != 1)
+        re->first_byte = -1;
+
+    /**
+     * A plain string, without groups, is simply searched for.
+     */
+    _Bool literal = (c.nodes[root].type == NODE_SEQUENCE);
+    unsigned int literal_length = 0;
+
+    for (int i = c.nodes[root].child; literal && (i >= 0); i = c.nodes[i].next)
+    {
+        literal = (c.nodes[i].type == NODE_CHAR);
+        literal_length += 1;
+    }
+
+    re->code = c.code;
+    re->count = c.count;
+    re->classes = c.classes;
+    re->groups = c.groups;
+    c.code = NULL;
+    c.classes = NULL;
+
+    /**
+     * The threads at each offset, and the stack, each hold at most one
+     * entry for each instruction; only those which consume a byte, or
+     * match, become threads.
+     */
+    unsigned int threads = 0;
+    for (unsigned int i = 0; i < re->count; i++)
+    {
+        if (re->code[i].op <= RE_MATCH)
+            threads += 1;
+    }
+
+    /**
+     * The DFA doesn't know which bytes surround an offset, so can't
+     * handle word boundaries.
+     */
+    re->dfa = true;
+    re->idle = -1;
+    for (unsigned int i = 0; i < re->count; i++)
+    {
+        if ((re->code[i].op == RE_WORD_BOUNDARY) || (re->code[i].op == RE_NOT_WORD_BOUNDARY))
+            re->dfa = false;
+    }
+
+    unsigned int slots = 2 * (re->groups + 1);
+
+    re->pattern = malloc(length + 1);
+    re->literal = literal ? malloc(literal_length + 1) : NULL;
+    re->lists[0].pc = malloc(threads * sizeof(int));
+    re->lists[1].pc = malloc(threads * sizeof(int));
+    re->lists[0].captures = malloc(threads * slots * sizeof(int));
+    re->lists[1].captures = malloc(threads * slots * sizeof(int));
+    re->marks = calloc(re->count, sizeof(unsigned int));
+    re->current = malloc(slots * sizeof(int));
+    re->stack = malloc((re->count + 1) * sizeof(frame_t));
+    re->kernel = malloc((re->count + 1) * sizeof(int));
+
+    if (!re->pattern || (literal && !re->literal) || !re->lists[0].pc ||
+        !re->lists[1].pc || !re->lists[0].captures || !re->lists[1].captures ||
+        !re->marks || !re->current || !re->stack || !re->kernel)
+    {
+        compiler_free(&c);
+        svm_regex_free(re);
+        return NULL;
+    }
+
+    memcpy(re->pattern, pattern, length);
+    re->pattern[length] = '\0';
+    re->length = length;
+
+    if (literal)
+    {
+        unsigned int j = 0;
+        for (int i = c.nodes[root].child; i >= 0; i = c.nodes[i].next)
+            re->literal[j++] = (char) c.nodes[i].value;
+        re->literal_length = literal_length;
+    }
+
+    compiler_free(&c);
+    return re;
+}
+
+
+/**
+ * Free a compiled pattern.
+ */
+void svm_regex_free(svm_regex_t * re)
+{
+    if (!re)
+        return;
+
+    free(re->pattern);
+    free(re->code);
+    free(re->classes);
+    free(re->literal);
+    free(re->lists[0].pc);
+    free(re->lists[1].pc);
+    free(re->lists[0].captures);
+    free(re->lists[1].captures);
+    free(re->marks);
+    free(re->current);
+    free(re->stack);
+    free(re->kernel);
+    dfa_free(re);
+    free(re);
+}
+
+
+/**
+ * Was the given pattern compiled from exactly this text?
+ */
+_Bool svm_regex_same(const svm_regex_t * re, const char *pattern, unsigned int length)
+{
+    return (re->length == length) && (memcmp(re->pattern, pattern, length) == 0);
+}
+
+
+/**
+ * Return the number of capturing groups.
+ */
+unsigned int svm_regex_groups(const svm_regex_t * re)
+{
+    return re->groups;
+}
+
+
+/**
+ * Begin a new step of the simulation, in which no instruction has yet
+ * been visited.
+ */
+static void next_generation(svm_regex_t * re)
+{
+    if (++re->generation == 0)
+    {
+        memset(re->marks, '\0', re->count * sizeof(unsigned int));
+        re->generation = 1;
+    }
+}
+
+
+/**
+ * Add a thread starting at the given instruction to the list, with the
+ * capture slots in `re->current`, at offset `pos` of the subject, which
+ * is described by the `enum position_flags` in `where`.
+ *
+ * Instructions which don't consume anything are followed here, in order
+ * of priority, so that the list only holds those which do.  Each is only
+ * visited once per generation, as a later visit would have lower
+ * priority and could only give the same result.
+ */
+static void add_thread(svm_regex_t * re, thread_list_t * list, int pc,
+                       unsigned int pos, int where, unsigned int slots)
+{
+    frame_t *stack = re->stack;
+    int *current = re->current;
+    unsigned int top = 0;
+
+    _Bool before = (where & WORD_BEFORE) != 0;
+    _Bool after = (where & WORD_AFTER) != 0;
+
+    stack[top].pc = pc;
+    stack[top].slot = -1;
+    top++;
+
+    while (top > 0)
+    {
+        frame_t f = stack[--top];
+
+        if (f.slot >= 0)
+        {
+            current[f.slot] = f.value;
+            continue;
+        }
+
+        pc = f.pc;
+
+        for (;;)
+        {
+            if (re->marks[pc] == re->generation)
+                break;
+            re->marks[pc] = re->generation;
+
+            const insn_t *i = &re->code[pc];
+
+            switch (i->op)
+            {
+            case RE_JMP:
+                pc = i->x;
+                continue;
+            case RE_SPLIT:
+                stack[top].pc = i->y;
+                stack[top].slot = -1;
+                top++;
+                pc = i->x;
+                continue;
+            case RE_SAVE:
+                if ((unsigned int) i->x < slots)
+                {
+                    stack[top].slot = i->x;
+                    stack[top].value = current[i->x];
+                    top++;
+                    current[i->x] = (int) pos;
+                }
+                pc++;
+                continue;
+            case RE_BOL:
+                if (!(where & AT_START))
+                    break;
+                pc++;
+                continue;
+            case RE_EOL:
+                if (!(where & AT_END))
+                    break;
+                pc++;
+                continue;
+            case RE_WORD_BOUNDARY:
+                if (before == after)
+                    break;
+                pc++;
+                continue;
+            case RE_NOT_WORD_BOUNDARY:
+                if (before != after)
+                    break;
+                pc++;
+                continue;
+            default:
+                list->pc[list->count] = pc;
+                memcpy(&list->captures[list->count * slots], current, slots * sizeof(int));
+                list->count++;
+                break;
+            }
+            break;
+        }
+    }
+}
+
+
+/**
+ * Describe the given offset of the subject.
+ */
+static int position(const unsigned char *subject, unsigned int length, unsigned int pos)
+{
+    return ((pos == 0) ? AT_START : 0) | ((pos == length) ? AT_END : 0) |
+        (((pos > 0) && is_word(subject[pos - 1])) ? WORD_BEFORE : 0) |
+        (((pos < length) && is_word(subject[pos])) ? WORD_AFTER : 0);
+}
+
+
+/**
+ * Find the next offset, from `pos`, at which a match might begin.
+ */
+static unsigned int skip_to_first(const svm_regex_t * re, const unsigned char *subject,
+                                  unsigned int length, unsigned int pos)
+{
+    if (re->first_byte >= 0)
+    {
+        const unsigned char *p = memchr(subject + pos, re->first_byte, length - pos);
+        return p ? (unsigned int) (p - subject) : length;
+    }
+
+    while ((pos < length) && !SET_HAS(re->first, subject[pos]))
+        pos++;
+    return pos;
+}
+
+
+/**
+ * Does the given instruction consume the byte `c`?
+ */
+static _Bool consumes(const svm_regex_t * re, const insn_t * i, int c)
+{
+    switch (i->op)
+    {
+    case RE_CHAR:
+        return (c == i->byte);
+    case RE_ANY:
+        return (c != '\n');
+    case RE_CLASS:
+        return SET_HAS(re->classes[i->x], c) != 0;
+    }
+    return false;
+}
+
+
+/**
+ * Order instructions, for sorting kernels.
+ */
+static int compare_pc(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+
+/**
+ * Find the DFA state with the given kernel, creating it if need be.
+ *
+ * Returns its index, or -1 if there are already too many states, or
+ * memory could not be allocated.
+ */
+static int find_state(svm_regex_t * re, const int *kernel, unsigned int count, _Bool start)
+{
+    for (unsigned int i = 0; i < re->state_count; i++)
+    {
+        const dfa_state_t *s = &re->states[i];
+
+        if ((s->start == start) && (s->kernel_count == count) &&
+            (memcmp(s->kernel, kernel, count * sizeof(int)) == 0))
+            return (int) i;
+    }
+
+    if ((re->state_count >= DFA_MAX_STATES) ||
+        !reserve((void **) &re->states, &re->state_slots, re->state_count,
+                 sizeof(dfa_state_t)))
+        return -1;
+
+    /**
+     * Find the threads of the new state by following everything which
+     * doesn't consume a byte from its kernel.  The state is only used
+     * before the end of the subject, so "$" can't match.
+     */
+    thread_list_t *list = &re->lists[0];
+    list->count = 0;
+    next_generation(re);
+
+    for (unsigned int i = 0; i < count; i++)
+        add_thread(re, list, kernel[i], 0, start ? AT_START : 0, 0);
+
+    dfa_state_t *s = &re->states[re->state_count];
+    memset(s, '\0', sizeof(dfa_state_t));
+    memset(s->next, 0xFF, sizeof(s->next));
+
+    s->kernel = malloc((count + list->count + 1) * sizeof(int));
+    if (!s->kernel)
+        return -1;
+
+    memcpy(s->kernel, kernel, count * sizeof(int));
+    s->kernel_count = count;
+    s->threads = s->kernel + count;
+    s->start = start;
+    s->accepting_at_end = -1;
+
+    for (unsigned int t = 0; t < list->count; t++)
+    {
+        if (re->code[list->pc[t]].op == RE_MATCH)
+            s->accepting = true;
+        else
+            s->threads[s->thread_count++] = list->pc[t];
+    }
+
+    return (int) re->state_count++;
+}
+
+
+/**
+ * Find the state which follows the given one when it consumes `c`,
+ * and record the transition.
+ */
+static int dfa_step(svm_regex_t * re, int state, int c)
+{
+    const dfa_state_t *s = &re->states[state];
+    unsigned int count = 0;
+
+    for (unsigned int t = 0; t < s->thread_count; t++)
+    {
+        if (consumes(re, &re->code[s->threads[t]], c))
+            re->kernel[count++] = s->threads[t] + 1;
+    }
+
+    /**
+     * A new match may begin at each offset, unless the pattern is
+     * anchored.
+     */
+    if (!re->anchored)
+        re->kernel[count++] = 0;
+
+    qsort(re->kernel, count, sizeof(int), compare_pc);
+
+    int next = find_state(re, re->kernel, count, false);
+    if (next >= 0)
+        re->states[state].next[c] = next;
+    return next;
+}
+
+
+/**
+ * Does the given state match at the end of the subject, where "$" does?
+ */
+static _Bool dfa_accepts_at_end(svm_regex_t * re, int state)
+{
+    dfa_state_t *s = &re->states[state];
+
+    if (s->accepting_at_end < 0)
+    {
+        thread_list_t *list = &re->lists[0];
+        list->count = 0;
+        next_generation(re);
+
+        for (unsigned int i = 0; i < s->kernel_count; i++)
+            add_thread(re, list, s->kernel[i], 0, AT_END | (s->start ? AT_START : 0), 0);
+
+        s->accepting_at_end = 0;
+        for (unsigned int t = 0; t < list->count; t++)
+        {
+            if (re->code[list->pc[t]].op == RE_MATCH)
+                s->accepting_at_end = 1;
+        }
+    }
+    return (s->accepting_at_end != 0);
+}
+
+
+/**
+ * Discard the DFA, once it has grown too large.
+ */
+static void dfa_free(svm_regex_t * re)
+{
+    for (unsigned int i = 0; i < re->state_count; i++)
+        free(re->states[i].kernel);
+
+    free(re->states);
+    re->states = NULL;
+    re->state_count = 0;
+    re->state_slots = 0;
+    re->idle = -1;
+    re->dfa = false;
+}
+
+
+/**
+ * Search the subject with the DFA, which only finds whether there is a
+ * match - but looks at each byte just once, usually with a single table
+ * lookup.
+ *
+ * Returns 1 if there is a match, 0 if not, or -1 if the DFA needs too
+ * many states.
+ */
+static int dfa_match(svm_regex_t * re, const unsigned char *subject, unsigned int length)
+{
+    int kernel = 0;
+
+    /**
+     * The first state created is the one we start in.
+     */
+    int state = (re->state_count > 0) ? 0 : find_state(re, &kernel, 1, true);
+    if (state < 0)
+        return -1;
+
+    for (unsigned int pos = 0; pos < length; pos++)
+    {
+        const dfa_state_t *s = &re->states[state];
+
+        if (s->accepting)
+            return 1;
+
+        if ((s->thread_count == 0) && re->anchored)
+            return 0;
+
+        /**
+         * If we're only waiting for a match to begin, skip to where one
+         * might.
+         */
+        if (re->skip && (s->kernel_count == 1) && (s->kernel[0] == 0))
+        {
+            unsigned int first = skip_to_first(re, subject, length, pos);
+            if (first >= length)
+                return 0;
+
+            if (first != pos)
+            {
+                if (re->idle < 0)
+                    re->idle = find_state(re, &kernel, 1, false);
+                if (re->idle < 0)
+                    return -1;
+
+                pos = first;
+                state = re->idle;
+                s = &re->states[state];
+            }
+        }
+
+        int next = s->next[subject[pos]];
+        if ((next < 0) && ((next = dfa_step(re, state, subject[pos])) < 0))
+            return -1;
+        state = next;
+    }
+
+    return dfa_accepts_at_end(re, state);
+}
+
+
+/**
+ * Search for a plain string.
+ */
+static _Bool match_literal(const svm_regex_t * re, const unsigned char *subject,
+                           unsigned int length, int *captures)
+{
+    unsigned int n = re->literal_length;
+    unsigned int pos = 0;
+
+    if (n > 0)
+    {
+        for (;;)
+        {
+            if (length - pos < n)
+                return false;
+
+            pos = skip_to_first(re, subject, length - n + 1, pos);
+            if (pos > length - n)
+                return false;
+
+            if (memcmp(subject + pos, re->literal, n) == 0)
+                break;
+            pos++;
+        }
+    }
+
+    if (captures)
+    {
+        captures[0] = (int) pos;
+        captures[1] = (int) (pos + n);
+    }
+    return true;
+}
+
+
+/**
+ * Search the subject for the pattern.
+ */
+_Bool svm_regex_match(svm_regex_t * re, const char *str, unsigned int length,
+                      int *captures)
+{
+    const unsigned char *subject = (const unsigned char *) str;
+    unsigned int slots = captures ? 2 * (re->groups + 1) : 0;
+
+    for (unsigned int i = 0; i < slots; i++)
+        captures[i] = -1;
+
+    if (re->literal)
+        return match_literal(re, subject, length, captures);
+
+    /**
+     * If there's no match the DFA finds out quickly.  Otherwise, if we
+     * want to know where the match is, we have to look again.
+     */
+    if (re->dfa)
+    {
+        int found = dfa_match(re, subject, length);
+
+        if (found < 0)
+            dfa_free(re);
+        else if (!found || !captures)
+            return (found != 0);
+    }
+
+    thread_list_t *current = &re->lists[0];
+    thread_list_t *next = &re->lists[1];
+    _Bool matched = false;
+
+    current->count = 0;
+    next_generation(re);
+
+    for (unsigned int pos = 0;; pos++)
+    {
+        /**
+         * Start a new thread here, with the lowest priority, unless we've
+         * already found a match which began earlier.  If nothing else is
+         * running we can skip to where one might begin.
+         */
+        if (!matched && ((pos == 0) || !re->anchored))
+        {
+            if ((current->count == 0) && re->skip)
+            {
+                unsigned int first = skip_to_first(re, subject, length, pos);
+                if (first >= length)
+                    break;
+
+                if (first != pos)
+                {
+                    pos = first;
+                    next_generation(re);
+                }
+            }
+
+            for (unsigned int i = 0; i < slots; i++)
+                re->current[i] = -1;
+            add_thread(re, current, 0, pos, position(subject, length, pos), slots);
+        }
+
+        /**
+         * With nothing running we can only carry on if a match might
+         * begin at the next offset.
+         */
+        if (current->count == 0)
+        {
+            if (matched || re->anchored || (pos >= length))
+                break;
+
+            next_generation(re);
+            continue;
+        }
+
+        next_generation(re);
+        next->count = 0;
+
+        int c = (pos < length) ? subject[pos] : -1;
+        int where = (pos < length) ? position(subject, length, pos + 1) : 0;
+
+        for (unsigned int t = 0; t < current->count; t++)
+        {
+            const insn_t *i = &re->code[current->pc[t]];
+            int *caps = &current->captures[t * slots];
+
+            if (i->op == RE_MATCH)
+            {
+                /**
+                 * Threads after this one have lower priority, so
+                 * they're abandoned - but those before it may still find
+                 * a preferred match.
+                 */
+                matched = true;
+                if (!captures)
+                    return true;
+
+                memcpy(captures, caps, slots * sizeof(int));
+                break;
+            }
+
+            if ((c < 0) || !consumes(re, i, c))
+                continue;
+
+            memcpy(re->current, caps, slots * sizeof(int));
+            add_thread(re, next, current->pc[t] + 1, pos + 1, where, slots);
+        }
+
+        thread_list_t *tmp = current;
+        current = next;
+        next = tmp;
+
+        if (pos >= length)
+            break;
+    }
+
+    return matched;
+}
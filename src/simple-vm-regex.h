@@ -0,0 +1,110 @@
+/**
+ * simple-vm-regex.h - Regular expressions for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#ifndef SIMPLE_VM_REGEX_H
+#define SIMPLE_VM_REGEX_H 1
+
+
+#include "simple-vm.h"
+
+
+/**
+ * The largest number of capturing groups a pattern may contain.
+ */
+#define SVM_REGEX_GROUPS 32
+
+
+/**
+ *
+ * A pattern is compiled into a small program, which is then run over
+ * the subject by simulating every possible path through it at once, so
+ * matching takes time proportional to the length of the subject times
+ * the size of the program - there is no backtracking.
+ *
+ * The syntax is the familiar subset of Perl's:
+ *
+ *    .  [abc]  [^a-z]  \d \w \s \D \W \S     Characters, and classes.
+ *    \n \t \r \f \v \0 \xHH \. \\             Escapes.
+ *    ^  $  \b  \B                             Anchors.
+ *    *  +  ?  {n}  {n,}  {n,m}                Repetition, which may be
+ *                                             followed by ? to be lazy.
+ *    (...)  (?:...)  a|b                      Grouping, and alternation.
+ *
+ * A match may begin anywhere in the subject unless the pattern is
+ * anchored, and the leftmost one is found, preferring earlier
+ * alternatives and greedy repetition.
+ *
+ * That is the match Perl finds, except where an unbounded repetition
+ * could match the empty string.  Perl takes one iteration which matches
+ * nothing and then leaves the loop, but here such an iteration is
+ * abandoned unless the minimum requires it - so "(a*)*" leaves its group
+ * unset against "b", rather than empty, and the lazy "([^a]??)*" takes
+ * a byte rather than stopping.  `examples/repeat.in` shows both.
+ *
+ */
+typedef struct svm_regex svm_regex_t;
+
+
+/**
+ * Compile the `length` bytes of the given pattern, returning NULL on
+ * failure.
+ *
+ * If the pattern is invalid `error` is set to a description of the
+ * problem, otherwise memory could not be allocated and it is NULL.
+ */
+svm_regex_t *svm_regex_compile(const char *pattern, unsigned int length,
+                               const char **error);
+
+
+/**
+ * Free a compiled pattern.
+ */
+void svm_regex_free(svm_regex_t * regex);
+
+
+/**
+ * Was the given pattern compiled from exactly this text?
+ */
+_Bool svm_regex_same(const svm_regex_t * regex, const char *pattern, unsigned int length);
+
+
+/**
+ * Return the number of capturing groups in the pattern.
+ */
+unsigned int svm_regex_groups(const svm_regex_t * regex);
+
+
+/**
+ * Search the `length` bytes of `subject` for the pattern, returning
+ * true if it matches.
+ *
+ * If `captures` isn't NULL it receives the offsets of the start and end
+ * of the whole match, followed by those of each group in turn - so it
+ * must have room for two more entries than twice the number of groups.
+ * Groups which took no part in the match have offsets of -1.
+ *
+ * The compiled pattern holds the memory used while matching, so it
+ * may only be used by one caller at a time.
+ */
+_Bool svm_regex_match(svm_regex_t * regex, const char *subject, unsigned int length,
+                      int *captures);
+
+
+#endif                          /* SIMPLE_VM_REGEX_H */
@@ -0,0 +1,557 @@
+/**
+ * simple-vm-vector.c - Array operations for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "simple-vm.h"
+#include "simple-vm-opcodes.h"
+#include "simple-vm-vector.h"
+
+
+
+/**
+ * The SIMD implementations use gcc's vector extensions, which are
+ * compiled for SSE2 and AVX2 regardless of the flags the rest of the
+ * machine is built with.  Elsewhere only the plain C implementation is
+ * available.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SVM_VECTOR_X86 1
+#endif
+
+
+
+/**
+ * Read, or write, the element of the given width at the given index.
+ */
+static uint64_t element(const unsigned char *p, int width, unsigned int i)
+{
+    uint64_t val = 0;
+
+    for (int b = 0; b < width; b++)
+        val |= (uint64_t) p[(i * width) + b] << (8 * b);
+    return val;
+}
+
+static void set_element(unsigned char *p, int width, unsigned int i, uint64_t val)
+{
+    for (int b = 0; b < width; b++)
+        p[(i * width) + b] = (val >> (8 * b)) & 0xFF;
+}
+
+
+/**
+ * Apply an operation, or reduction, to a pair of values.
+ */
+static uint64_t apply(int operation, uint64_t x, uint64_t y)
+{
+    switch (operation)
+    {
+    case VECTOR_ADD:
+        return x + y;
+    case VECTOR_SUB:
+        return x - y;
+    case VECTOR_MUL:
+        return x * y;
+    case VECTOR_AND:
+        return x & y;
+    case VECTOR_OR:
+        return x | y;
+    case VECTOR_XOR:
+        return x ^ y;
+    }
+    return 0;
+}
+
+static uint64_t combine(int reduction, uint64_t x, uint64_t y)
+{
+    switch (reduction)
+    {
+    case VECTOR_SUM:
+        return x + y;
+    case VECTOR_MIN:
+        return (x < y) ? x : y;
+    case VECTOR_MAX:
+        return (x > y) ? x : y;
+    }
+    return 0;
+}
+
+
+
+/**
+ * An implementation processes as many whole vectors from the start of its
+ * arrays as it can, returning the number of elements it dealt with, and
+ * the plain C code deals with those which remain.
+ *
+ * The reductions, and dot-product, combine the elements they process with
+ * the value `result` already holds.
+ *
+ * Each has an entry for elements of one, two, and four bytes.
+ */
+typedef struct vector_implementation {
+    const char *name;
+
+    unsigned int (*map[3]) (int operation, unsigned char *dst, const unsigned char *a,
+                            const unsigned char *b, unsigned int count);
+
+    unsigned int (*reduce[3]) (int reduction, const unsigned char *a, unsigned int count,
+                               uint64_t * result);
+
+    unsigned int (*dot[3]) (const unsigned char *a, const unsigned char *b,
+                            unsigned int count, uint64_t * result);
+} vector_implementation_t;
+
+
+static const vector_implementation_t scalar = { "scalar", {NULL}, {NULL}, {NULL} };
+
+
+
+#ifdef SVM_VECTOR_X86
+
+/**
+ * Vectors of 16 bytes, for SSE2, and 32 bytes, for AVX2.
+ *
+ * Sums are accumulated in vectors of 64-bit lanes of the same size, each
+ * lane of which holds the sum of the elements which were packed into it.
+ * Widening to one 64-bit lane per element instead would need vectors
+ * wider than the registers, which is much slower.
+ */
+typedef uint8_t u8x16 __attribute__ ((vector_size(16)));
+typedef uint16_t u16x8 __attribute__ ((vector_size(16)));
+typedef uint32_t u32x4 __attribute__ ((vector_size(16)));
+typedef uint64_t u64x2 __attribute__ ((vector_size(16)));
+typedef uint8_t u8x32 __attribute__ ((vector_size(32)));
+typedef uint16_t u16x16 __attribute__ ((vector_size(32)));
+typedef uint32_t u32x8 __attribute__ ((vector_size(32)));
+typedef uint64_t u64x4 __attribute__ ((vector_size(32)));
+
+
+/**
+ * Define the function `name`, for the given instruction-set, which
+ * applies an operation to vectors of type V, holding elements of type T.
+ */
+#define MAP_KERNEL(name, isa, V, T) \
+static unsigned int __attribute__ ((target(isa))) \
+name(int operation, unsigned char *dst, const unsigned char *a, \
+     const unsigned char *b, unsigned int count) \
+{ \
+    const unsigned int lanes = sizeof(V) / sizeof(T); \
+    unsigned int i = 0; \
+\
+    for (; i + lanes <= count; i += lanes) \
+    { \
+        V x, y; \
+        memcpy(&x, a + (i * sizeof(T)), sizeof(V)); \
+        memcpy(&y, b + (i * sizeof(T)), sizeof(V)); \
+\
+        switch (operation) \
+        { \
+        case VECTOR_ADD: x += y; break; \
+        case VECTOR_SUB: x -= y; break; \
+        case VECTOR_MUL: x *= y; break; \
+        case VECTOR_AND: x &= y; break; \
+        case VECTOR_OR:  x |= y; break; \
+        case VECTOR_XOR: x ^= y; break; \
+        } \
+        memcpy(dst + (i * sizeof(T)), &x, sizeof(V)); \
+    } \
+    return i; \
+}
+
+
+/**
+ * Define the function `name` which reduces vectors of type V, holding
+ * elements of type T, summing them in the vector of 64-bit lanes W.
+ */
+#define REDUCE_KERNEL(name, isa, V, T, W) \
+static unsigned int __attribute__ ((target(isa))) \
+name(int reduction, const unsigned char *a, unsigned int count, uint64_t * result) \
+{ \
+    const unsigned int lanes = sizeof(V) / sizeof(T); \
+    const unsigned int bits = 8 * sizeof(T); \
+    unsigned int i = 0; \
+    W sum = { 0 }; \
+    V lo, hi; \
+\
+    memset(&lo, 0xFF, sizeof(V)); \
+    memset(&hi, 0x00, sizeof(V)); \
+\
+    for (; i + lanes <= count; i += lanes) \
+    { \
+        V x, m; \
+        W w; \
+        memcpy(&x, a + (i * sizeof(T)), sizeof(V)); \
+\
+        switch (reduction) \
+        { \
+        case VECTOR_SUM: \
+            memcpy(&w, &x, sizeof(W)); \
+            for (unsigned int s = 0; s < 64; s += bits) \
+                sum += (w >> s) & (T) ~ 0; \
+            break; \
+        case VECTOR_MIN: \
+            m = (V) (x < lo); \
+            lo = (x & m) | (lo & ~m); \
+            break; \
+        case VECTOR_MAX: \
+            m = (V) (x > hi); \
+            hi = (x & m) | (hi & ~m); \
+            break; \
+        } \
+    } \
+\
+    if (i == 0) \
+        return 0; \
+\
+    if (reduction == VECTOR_SUM) \
+    { \
+        for (unsigned int l = 0; l < sizeof(W) / sizeof(uint64_t); l++) \
+            *result += sum[l]; \
+    } else \
+    { \
+        for (unsigned int l = 0; l < lanes; l++) \
+            *result = combine(reduction, *result, \
+                              (reduction == VECTOR_MIN) ? lo[l] : hi[l]); \
+    } \
+    return i; \
+}
+
+
+/**
+ * Define the function `name` which sums the products of vectors of type
+ * V, holding elements of type T, in the vector of 64-bit lanes W.
+ *
+ * Each element is at most 32 bits, so each product is that of the low
+ * halves of two 64-bit lanes - which SSE2 and AVX2 can multiply.
+ */
+#define DOT_KERNEL(name, isa, V, T, W) \
+static unsigned int __attribute__ ((target(isa))) \
+name(const unsigned char *a, const unsigned char *b, unsigned int count, \
+     uint64_t * result) \
+{ \
+    const unsigned int lanes = sizeof(V) / sizeof(T); \
+    const unsigned int bits = 8 * sizeof(T); \
+    unsigned int i = 0; \
+    W sum = { 0 }; \
+\
+    for (; i + lanes <= count; i += lanes) \
+    { \
+        W x, y; \
+        memcpy(&x, a + (i * sizeof(T)), sizeof(W)); \
+        memcpy(&y, b + (i * sizeof(T)), sizeof(W)); \
+\
+        for (unsigned int s = 0; s < 64; s += bits) \
+            sum += ((x >> s) & (T) ~ 0) * ((y >> s) & (T) ~ 0); \
+    } \
+\
+    for (unsigned int l = 0; l < sizeof(W) / sizeof(uint64_t); l++) \
+        *result += sum[l]; \
+    return i; \
+}
+
+
+MAP_KERNEL(sse2_map8, "sse2", u8x16, uint8_t)
+MAP_KERNEL(sse2_map16, "sse2", u16x8, uint16_t)
+MAP_KERNEL(sse2_map32, "sse2", u32x4, uint32_t)
+REDUCE_KERNEL(sse2_reduce8, "sse2", u8x16, uint8_t, u64x2)
+REDUCE_KERNEL(sse2_reduce16, "sse2", u16x8, uint16_t, u64x2)
+REDUCE_KERNEL(sse2_reduce32, "sse2", u32x4, uint32_t, u64x2)
+DOT_KERNEL(sse2_dot8, "sse2", u8x16, uint8_t, u64x2)
+DOT_KERNEL(sse2_dot16, "sse2", u16x8, uint16_t, u64x2)
+DOT_KERNEL(sse2_dot32, "sse2", u32x4, uint32_t, u64x2)
+
+MAP_KERNEL(avx2_map8, "avx2", u8x32, uint8_t)
+MAP_KERNEL(avx2_map16, "avx2", u16x16, uint16_t)
+MAP_KERNEL(avx2_map32, "avx2", u32x8, uint32_t)
+REDUCE_KERNEL(avx2_reduce8, "avx2", u8x32, uint8_t, u64x4)
+REDUCE_KERNEL(avx2_reduce16, "avx2", u16x16, uint16_t, u64x4)
+REDUCE_KERNEL(avx2_reduce32, "avx2", u32x8, uint32_t, u64x4)
+DOT_KERNEL(avx2_dot8, "avx2", u8x32, uint8_t, u64x4)
+DOT_KERNEL(avx2_dot16, "avx2", u16x16, uint16_t, u64x4)
+DOT_KERNEL(avx2_dot32, "avx2", u32x8, uint32_t, u64x4)
+
+
+static const vector_implementation_t sse2 = {
+    "sse2",
+    {sse2_map8, sse2_map16, sse2_map32},
+    {sse2_reduce8, sse2_reduce16, sse2_reduce32},
+    {sse2_dot8, sse2_dot16, sse2_dot32},
+};
+
+static const vector_implementation_t avx2 = {
+    "avx2",
+    {avx2_map8, avx2_map16, avx2_map32},
+    {avx2_reduce8, avx2_reduce16, avx2_reduce32},
+    {avx2_dot8, avx2_dot16, avx2_dot32},
+};
+
+#endif                          /* SVM_VECTOR_X86 */
+
+
+
+/**
+ * Choose the implementation to use, the first time we're called.
+ */
+static const vector_implementation_t *implementation(void)
+{
+    static const vector_implementation_t *chosen = NULL;
+
+    if (chosen)
+        return chosen;
+
+    const char *name = getenv("SVM_VECTOR");
+    if (name && (*name == '\0'))
+        name = NULL;
+
+    chosen = &scalar;
+
+#ifdef SVM_VECTOR_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && (!name || strcmp(name, "avx2") == 0))
+        chosen = &avx2;
+    else if (__builtin_cpu_supports("sse2") && (!name || strcmp(name, "scalar") != 0))
+        chosen = &sse2;
+#else
+    (void) name;
+#endif
+
+    return chosen;
+}
+
+
+/**
+ * Map the width of an element to an index into an implementation.
+ */
+static int slot(int width)
+{
+    return (width == 1) ? 0 : (width == 2) ? 1 : 2;
+}
+
+
+
+void svm_vector_map(int operation, int width, unsigned char *dst,
+                    const unsigned char *a, const unsigned char *b, unsigned int count)
+{
+    const vector_implementation_t *impl = implementation();
+    unsigned int i = 0;
+
+    /**
+     * Whole vectors may only be used if no element is written before an
+     * element at the same address is read.
+     */
+    size_t size = (size_t) count * width;
+    _Bool overlaps = ((dst > a) && (dst < a + size)) || ((dst > b) && (dst < b + size));
+
+    if (impl->map[slot(width)] && !overlaps)
+        i = impl->map[slot(width)] (operation, dst, a, b, count);
+
+    for (; i < count; i++)
+        set_element(dst, width, i,
+                    apply(operation, element(a, width, i), element(b, width, i)));
+}
+
+
+uint64_t svm_vector_reduce(int reduction, int width, const unsigned char *a,
+                           unsigned int count)
+{
+    const vector_implementation_t *impl = implementation();
+    unsigned int i = 0;
+
+    if (count == 0)
+        return 0;
+
+    uint64_t result = (reduction == VECTOR_MIN) ? UINT64_MAX : 0;
+
+    if (impl->reduce[slot(width)])
+        i = impl->reduce[slot(width)] (reduction, a, count, &result);
+
+    for (; i < count; i++)
+        result = combine(reduction, result, element(a, width, i));
+
+    return result;
+}
+
+
+uint64_t svm_vector_dot(int width, const unsigned char *a, const unsigned char *b,
+                        unsigned int count)
+{
+    const vector_implementation_t *impl = implementation();
+    unsigned int i = 0;
+    uint64_t result = 0;
+
+    if (impl->dot[slot(width)])
+        i = impl->dot[slot(width)] (a, b, count, &result);
+
+    for (; i < count; i++)
+        result += element(a, width, i) * element(b, width, i);
+
+    return result;
+}
+
+
+/**
+ * Each total depends upon the one before it, so this is always done one
+ * element at a time.
+ */
+void svm_vector_scan(int width, unsigned char *dst, const unsigned char *a,
+                     unsigned int count)
+{
+    uint64_t total = 0;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        total += element(a, width, i);
+        set_element(dst, width, i, total);
+    }
+}
+
+
+/**
+ * Below this many elements an insertion sort beats the overhead of the
+ * radix sort's passes.
+ */
+#define SORT_INSERTION_LIMIT 32
+
+
+/**
+ * An element being sorted, along with the value which moves with it.
+ *
+ * The key is stored inverted when sorting in descending order, so that
+ * both orders can be sorted as ascending.
+ */
+typedef struct sort_item {
+    uint32_t key;
+    uint32_t value;
+} sort_item_t;
+
+
+/**
+ * A stable least-significant-digit radix sort, by one byte of the key at
+ * a time - skipping the bytes which every key shares.
+ *
+ * The sorted items end up in `items`, and `tmp` must be as large.
+ */
+static void radix_sort(sort_item_t * items, sort_item_t * tmp, unsigned int count,
+                       int width)
+{
+    for (int shift = 0; shift < 8 * width; shift += 8)
+    {
+        unsigned int offsets[256] = { 0 };
+
+        for (unsigned int i = 0; i < count; i++)
+            offsets[(items[i].key >> shift) & 0xFF]++;
+
+        if (offsets[(items[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        unsigned int total = 0;
+        for (int d = 0; d < 256; d++)
+        {
+            unsigned int n = offsets[d];
+            offsets[d] = total;
+            total += n;
+        }
+
+        for (unsigned int i = 0; i < count; i++)
+            tmp[offsets[(items[i].key >> shift) & 0xFF]++] = items[i];
+
+        memcpy(items, tmp, count * sizeof(sort_item_t));
+    }
+}
+
+
+_Bool svm_vector_sort(int order, int width, unsigned char *a, unsigned int count)
+{
+    int stride = (order & VECTOR_PAIRS) ? 2 : 1;
+    uint32_t mask = (width == 4) ? UINT32_MAX : (1u << (8 * width)) - 1;
+    uint32_t invert = (order & VECTOR_DESCENDING) ? mask : 0;
+
+    if (count < 2)
+        return true;
+
+    sort_item_t *items = malloc(2 * count * sizeof(sort_item_t));
+    if (!items)
+        return false;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        items[i].key = element(a, width, i * stride) ^ invert;
+        items[i].value = (stride == 2) ? element(a, width, (i * stride) + 1) : 0;
+    }
+
+    if (count < SORT_INSERTION_LIMIT)
+    {
+        for (unsigned int i = 1; i < count; i++)
+        {
+            sort_item_t item = items[i];
+            unsigned int j = i;
+
+            for (; (j > 0) && (items[j - 1].key > item.key); j--)
+                items[j] = items[j - 1];
+            items[j] = item;
+        }
+    } else
+    {
+        radix_sort(items, items + count, count, width);
+    }
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        set_element(a, width, i * stride, items[i].key ^ invert);
+        if (stride == 2)
+            set_element(a, width, (i * stride) + 1, items[i].value);
+    }
+
+    free(items);
+    return true;
+}
+
+
+unsigned int svm_vector_search(int order, int width, const unsigned char *a,
+                               unsigned int count, uint64_t key, _Bool * found)
+{
+    int stride = (order & VECTOR_PAIRS) ? 2 : 1;
+    _Bool descending = (order & VECTOR_DESCENDING) != 0;
+    unsigned int lo = 0, hi = count;
+
+    while (lo < hi)
+    {
+        unsigned int mid = lo + ((hi - lo) / 2);
+        uint64_t val = element(a, width, mid * stride);
+
+        if (descending ? (val > key) : (val < key))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *found = (lo < count) && (element(a, width, lo * stride) == key);
+    return lo;
+}
+
+
+const char *svm_vector_implementation(void)
+{
+    return (implementation()->name);
+}
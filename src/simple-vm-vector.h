@@ -0,0 +1,113 @@
+/**
+ * simple-vm-vector.h - Array operations for simple virtual machine.
+ *
+ * Copyright (c) 2014 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ *
+ **
+ *
+ */
+
+
+#ifndef SIMPLE_VM_VECTOR_H
+#define SIMPLE_VM_VECTOR_H 1
+
+
+#include <stdint.h>
+
+
+/**
+ *
+ * These routines implement the vector opcodes.  Each works upon arrays
+ * of `count` unsigned, little-endian, elements which are `width` bytes
+ * wide - one, two, or four.
+ *
+ * The first time one is called the fastest implementation the CPU
+ * supports is chosen - AVX2, SSE2, or plain C - unless the environment
+ * variable SVM_VECTOR names another.  Every implementation gives exactly
+ * the same results.
+ *
+ */
+
+
+/**
+ * Apply the given `enum vector_operation_values` to each pair of elements
+ * of `a` and `b`, storing the results in `dst`.
+ *
+ * The arrays may overlap, in which case the result is as if the elements
+ * were processed one at a time, from the first.
+ */
+void svm_vector_map(int operation, int width, unsigned char *dst,
+                    const unsigned char *a, const unsigned char *b, unsigned int count);
+
+
+/**
+ * Return the sum, minimum, or maximum - as given by the
+ * `enum vector_reduction_values` - of the elements of `a`.
+ *
+ * Sums wrap around modulo 2^64, and every reduction of an empty array
+ * gives zero.
+ */
+uint64_t svm_vector_reduce(int reduction, int width, const unsigned char *a,
+                           unsigned int count);
+
+
+/**
+ * Return the sum of the products of each pair of elements of `a` and `b`,
+ * modulo 2^64.
+ */
+uint64_t svm_vector_dot(int width, const unsigned char *a, const unsigned char *b,
+                        unsigned int count);
+
+
+/**
+ * Store the running totals of the elements of `a` in `dst`, so that each
+ * element of `dst` is the sum of that element of `a` and all those before
+ * it, wrapping around at the width of an element.
+ */
+void svm_vector_scan(int width, unsigned char *dst, const unsigned char *a,
+                     unsigned int count);
+
+
+/**
+ * Sort the `count` elements of `a` in place, in the order given by the
+ * `enum vector_order_values`.
+ *
+ * When sorting pairs each element is followed by a value which moves
+ * with it.  The sort is stable, so equal elements keep their order.
+ *
+ * Returns false if memory could not be allocated, in which case the
+ * array is unchanged.
+ */
+_Bool svm_vector_sort(int order, int width, unsigned char *a, unsigned int count);
+
+
+/**
+ * Search the `count` elements of `a`, which are sorted in the given order,
+ * for `key`.
+ *
+ * Returns the index of the first element which doesn't come before the
+ * key - which is where the key would be inserted if it isn't present -
+ * and sets `found` if that element is equal to it.
+ */
+unsigned int svm_vector_search(int order, int width, const unsigned char *a,
+                               unsigned int count, uint64_t key, _Bool * found);
+
+
+/**
+ * Return the name of the implementation in use - "avx2", "sse2", or
+ * "scalar".
+ */
+const char *svm_vector_implementation(void);
+
+
+#endif                          /* SIMPLE_VM_VECTOR_H */
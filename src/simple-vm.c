@@ -21,10 +21,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 #include "simple-vm.h"
+#include "simple-vm-object.h"
 #include "simple-vm-opcodes.h"
+#include "simple-vm-map.h"
+#include "simple-vm-regex.h"
 
 
 /**
@@ -51,7 +57,7 @@
  *
  *   STORE Register-For-Result NUMBER
  *
- * The machine has 10 registers total, numbered 00-09.
+ * The machine has REGISTER_COUNT registers, 256 by default, numbered from 00.
  *
  *
  * Steve
@@ -96,6 +102,71 @@ void svm_default_error_handler(svm_t * cpup, char *msg)
 
 
 
+/**
+ * Free the pages of banked memory, and the table of them.
+ */
+static void release_pages(svm_t * cpup)
+{
+    if (!cpup->pages)
+        return;
+
+    for (unsigned int i = 0; i < (SVM_BANK_COUNT - 1) * SVM_BANK_PAGES; i++)
+        free(cpup->pages[i]);
+
+    free(cpup->pages);
+    cpup->pages = NULL;
+}
+
+
+
+/**
+ * Free every hash-map, and the table of them.
+ */
+static void release_maps(svm_t * cpup)
+{
+    for (unsigned int i = 0; i < cpup->map_slots; i++)
+        svm_map_free(cpup->maps[i]);
+
+    free(cpup->maps);
+    cpup->maps = NULL;
+    cpup->map_slots = 0;
+}
+
+
+
+/**
+ * Empty the stack, freeing any strings held upon it.
+ */
+static void clear_stack(svm_t * cpup)
+{
+    for (int i = 1; i <= cpup->SP; i++)
+    {
+        if (cpup->stack_types[i] == STRING)
+            free(cpup->stack[i].string);
+    }
+
+    cpup->SP = 0;
+    cpup->FP = 0;
+}
+
+
+
+/**
+ * Free every compiled regular expression, and the cache of them.
+ */
+static void release_regexes(svm_t * cpup)
+{
+    if (!cpup->regexes)
+        return;
+
+    for (unsigned int i = 0; i < SVM_REGEX_CACHE; i++)
+        svm_regex_free(cpup->regexes[i]);
+
+    free(cpup->regexes);
+    cpup->regexes = NULL;
+}
+
+
 
 /**
  * Allocate a new virtual machine instance.
@@ -105,9 +176,8 @@ void svm_default_error_handler(svm_t * cpup, char *msg)
 svm_t *svm_new(unsigned char *code, unsigned int size)
 {
     svm_t *cpun;
-    int i;
 
-    if (!code || !size || (size > 0xFFFF))
+    if (!code || !size)
         return NULL;
 
     /**
@@ -129,9 +199,136 @@ svm_t *svm_new(unsigned char *code, unsigned int size)
     }
 
     cpun->error_handler = NULL;
-    cpun->ip = 0;
-    cpun->running = true;
-    cpun->size = size;
+
+    /**
+     * Load the program, and setup the initial state.
+     */
+    if (!svm_reset(cpun, code, size))
+    {
+        free(cpun->code);
+        free(cpun);
+        return NULL;
+    }
+
+    /**
+     * Setup our default opcode-handlers
+     */
+    opcode_init(cpun);
+
+    return cpun;
+}
+
+
+/**
+ * Allocate a new virtual machine instance, running the program in the
+ * given file.
+ *
+ * Raw bytecode is mapped privately as the machine's RAM, on top of an
+ * anonymous 64k mapping, so nothing is copied: pages of the program are
+ * read as they are first executed, and any write - by self-modifying
+ * code, or `poke` - gets a private copy of that page.  Object-files
+ * can't be used in-place, as their code doesn't start on a page, so they
+ * are mapped read-only and loaded as usual.
+ *
+ * Returns NULL if the file can't be mapped, for example because it is a
+ * pipe, in which case the caller should read it and use `svm_new`.
+ */
+svm_t *svm_new_from_fd(int fd)
+{
+    struct stat sb;
+    unsigned char magic[4];
+    svm_t *cpun;
+
+    if ((fstat(fd, &sb) != 0) || !S_ISREG(sb.st_mode) || (sb.st_size < 1))
+        return NULL;
+
+    size_t size = sb.st_size;
+
+    if ((size > 0xFFFF) ||
+        ((pread(fd, magic, sizeof(magic), 0) == sizeof(magic)) &&
+         (memcmp(magic, SVM_OBJECT_MAGIC, sizeof(magic)) == 0)))
+    {
+        unsigned char *file = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file == MAP_FAILED)
+            return NULL;
+
+        cpun = svm_new(file, size);
+        munmap(file, size);
+        return cpun;
+    }
+
+    /**
+     * Reserve 64k of zeroed RAM, then map the program over the start.
+     */
+    unsigned char *ram = mmap(NULL, 0x10000, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ram == MAP_FAILED)
+        return NULL;
+
+    if (mmap(ram, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+        MAP_FAILED)
+    {
+        munmap(ram, 0x10000);
+        return NULL;
+    }
+
+    cpun = malloc(sizeof(struct svm));
+    if (!cpun)
+    {
+        munmap(ram, 0x10000);
+        return NULL;
+    }
+    memset(cpun, '\0', sizeof(struct svm));
+
+    cpun->code = ram;
+    cpun->code_mapped = true;
+
+    svm_reset(cpun, ram, size);
+    opcode_init(cpun);
+
+    return cpun;
+}
+
+
+/**
+ * Reset an existing virtual machine instance, loading the given code.
+ *
+ * Any strings held in registers are released, and the RAM is cleared
+ * before the new program is copied into it - so the end result is
+ * identical to a freshly allocated machine, minus the allocation.
+ *
+ * The code may be either raw bytecode, or an object-file, in which case
+ * its code-section is loaded and execution begins at its entry-point.
+ *
+ * If the code is the machine's own RAM then the program already there is
+ * restarted, as it stands.
+ */
+_Bool svm_reset(svm_t * cpup, unsigned char *code, unsigned int size)
+{
+    int i;
+    unsigned int entry = 0;
+
+    if (!cpup || (size && !code))
+        return false;
+
+    if (svm_object_is(code, size))
+    {
+        svm_object_t obj;
+
+        if (!svm_object_load(code, size, &obj))
+            return false;
+
+        code = (unsigned char *) obj.code;
+        size = obj.code_size;
+        entry = obj.header->entry;
+    }
+
+    if (size > 0xFFFF)
+        return false;
+
+    cpup->ip = entry;
+    cpup->running = true;
+    cpup->size = size;
 
 
     /**
@@ -142,37 +339,46 @@ svm_t *svm_new(unsigned char *code, unsigned int size)
      * have fun writing self-modifying code, & etc.
      *
      */
-    memset(cpun->code, '\0', 0xFFFF);
-    memcpy(cpun->code, code, size);
+    if (code != cpup->code)
+    {
+        memset(cpup->code, '\0', 0xFFFF);
+        if (size)
+            memcpy(cpup->code, code, size);
+    }
 
 
     /**
-     * Explicitly zero each register and set to be a number.
+     * Explicitly zero each register and set to be a number, releasing
+     * any string a previous program might have left behind.
      */
     for (i = 0; i < REGISTER_COUNT; i++)
-    {
-        cpun->registers[i].type = INTEGER;
-        cpun->registers[i].content.integer = 0;
-        cpun->registers[i].content.string = NULL;
-    }
+        REGISTER_RELEASE(cpup, i);
 
     /**
      * Reset the flags.
      */
-    cpun->flags.z = false;
+    memset(&cpup->flags, '\0', sizeof(flag_t));
 
 
     /**
-     * Stack is empty.
+     * Release any banked memory, and return to the program's RAM.
      */
-    cpun->SP = 0;
+    release_pages(cpup);
+    cpup->bank = 0;
+
 
     /**
-     * Setup our default opcode-handlers
+     * Release any hash-maps.
      */
-    opcode_init(cpun);
+    release_maps(cpup);
 
-    return cpun;
+
+    /**
+     * Stack is empty, although it keeps the room it has grown to.
+     */
+    clear_stack(cpup);
+
+    return true;
 }
 
 
@@ -206,28 +412,149 @@ void svm_dump_registers(svm_t * cpup)
 
     for (i = 0; i < REGISTER_COUNT; i++)
     {
-        if (cpup->registers[i].type == STRING)
+        /**
+         * Beyond the first ten only show registers which have been used.
+         */
+        if ((i >= 10) && REGISTER_IS_INTEGER(cpup, i) && (REGISTER_INTEGER(cpup, i) == 0))
+            continue;
+
+        if (REGISTER_IS_STRING(cpup, i))
         {
-            printf("\tRegister %02d - str: %s\n", i, cpup->registers[i].content.string);
-        } else if (cpup->registers[i].type == INTEGER)
+            printf("\tRegister %02d - str: %s\n", i, REGISTER_STRING(cpup, i));
+        } else if (REGISTER_IS_INTEGER(cpup, i))
         {
-            printf("\tRegister %02d - Decimal:%04d [Hex:%04X]\n", i,
-                   cpup->registers[i].content.integer,
-                   cpup->registers[i].content.integer);
+            printf("\tRegister %02d - Decimal:%04" PRId64 " [Hex:%04" PRIX64 "]\n", i,
+                   REGISTER_INTEGER(cpup, i), REGISTER_INTEGER(cpup, i));
         } else
         {
             printf("\tRegister %02d has unknown type!\n", i);
         }
     }
 
-    if (cpup->flags.z == true)
+    printf("\tZ-FLAG:%s\n", cpup->flags.z ? "true" : "false");
+    printf("\tC-FLAG:%s\n", cpup->flags.c ? "true" : "false");
+    printf("\tS-FLAG:%s\n", cpup->flags.s ? "true" : "false");
+    printf("\tO-FLAG:%s\n", cpup->flags.o ? "true" : "false");
+
+}
+
+
+/**
+ * Enable edge-coverage recording, into either the supplied bitmap or
+ * one we allocate ourselves.
+ */
+_Bool svm_coverage_enable(svm_t * cpup, unsigned char *bitmap)
+{
+    if (!cpup)
+        return false;
+
+    if (cpup->coverage && cpup->coverage_owned)
+        free(cpup->coverage);
+
+    cpup->coverage = bitmap;
+    cpup->coverage_owned = false;
+
+    if (!bitmap)
     {
-        printf("\tZ-FLAG:true\n");
-    } else
+        cpup->coverage = malloc(SVM_COVERAGE_SIZE);
+        if (!cpup->coverage)
+            return false;
+
+        memset(cpup->coverage, '\0', SVM_COVERAGE_SIZE);
+        cpup->coverage_owned = true;
+    }
+    return true;
+}
+
+
+/**
+ * Return the edge-coverage bitmap.
+ */
+unsigned char *svm_coverage_bitmap(svm_t * cpup)
+{
+    if (!cpup)
+        return NULL;
+
+    return (cpup->coverage);
+}
+
+
+/**
+ * Count the edges which have been hit at least once.
+ */
+unsigned int svm_coverage_edges(svm_t * cpup)
+{
+    unsigned int count = 0;
+
+    if (!cpup || !cpup->coverage)
+        return 0;
+
+    for (int i = 0; i < SVM_COVERAGE_SIZE; i++)
+        if (cpup->coverage[i])
+            count++;
+
+    return count;
+}
+
+
+/**
+ * Forget all the edges we've recorded.
+ */
+void svm_coverage_clear(svm_t * cpup)
+{
+    if (cpup && cpup->coverage)
+        memset(cpup->coverage, '\0', SVM_COVERAGE_SIZE);
+}
+
+
+/**
+ * Enable execution profiling.
+ */
+_Bool svm_profile_enable(svm_t * cpup)
+{
+    if (!cpup)
+        return false;
+
+    if (cpup->profile)
+        return true;
+
+    cpup->profile = calloc(0xFFFF, sizeof(unsigned int));
+    return (cpup->profile != NULL);
+}
+
+
+/**
+ * Return the execution counts.
+ */
+unsigned int *svm_profile_counts(svm_t * cpup)
+{
+    if (!cpup)
+        return NULL;
+
+    return (cpup->profile);
+}
+
+
+/**
+ * Write the execution counts to the named file.
+ */
+_Bool svm_profile_write(svm_t * cpup, const char *filename)
+{
+    if (!cpup || !cpup->profile)
+        return false;
+
+    FILE *fp = fopen(filename, "w");
+    if (!fp)
+        return false;
+
+    for (int i = 0; i < 0xFFFF; i++)
     {
-        printf("\tZ-FLAG:false\n");
+        if (cpup->profile[i])
+            fprintf(fp, "%04X %u\n", i, cpup->profile[i]);
     }
 
+    fclose(fp);
+    return true;
 }
 
 
@@ -241,9 +568,24 @@ void svm_free(svm_t * cpup)
 
     if ( cpup->code )
     {
-        free(cpup->code);
+        if (cpup->code_mapped)
+            munmap(cpup->code, 0x10000);
+        else
+            free(cpup->code);
         cpup->code=NULL;
     }
+    if (cpup->coverage && cpup->coverage_owned)
+        free(cpup->coverage);
+    if (cpup->profile)
+        free(cpup->profile);
+    release_pages(cpup);
+    release_maps(cpup);
+    release_regexes(cpup);
+    clear_stack(cpup);
+    free(cpup->stack);
+    free(cpup->stack_types);
+    free(cpup->natives);
+    free(cpup->extensions);
     free(cpup);
 }
 
@@ -284,9 +626,9 @@ void svm_run_N_instructions(svm_t * cpup, int max_instructions)
 
 
     /**
-     * The code will start executing from offset 0.
+     * The code will start executing from the entry-point set when it was
+     * loaded - offset 0, unless an object-file says otherwise.
      */
-    cpup->ip = 0;
 
 
     /**
@@ -311,6 +653,12 @@ void svm_run_N_instructions(svm_t * cpup, int max_instructions)
          */
         int opcode = cpup->code[cpup->ip];
 
+        /**
+         * Count the execution of this address, if we're profiling.
+         */
+        if (cpup->profile)
+            cpup->profile[cpup->ip]++;
+
 
         if (getenv("DEBUG") != NULL)
             printf("%04x - Parsing OpCode Hex:%02X\n", cpup->ip, opcode);
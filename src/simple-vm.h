@@ -22,11 +22,100 @@
 #define SIMPLE_VM_H 1
 
 
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
 
 /**
  * Count of registers.
+ *
+ * Register numbers are encoded in a single byte, so there may be up to
+ * 256 of them.  Embedders who want a smaller machine may build with, for
+ * example, `-DREGISTER_COUNT=16`; any instruction which refers to a
+ * register beyond the end will still fail with "Register out of bounds".
+ */
+#ifndef REGISTER_COUNT
+#define REGISTER_COUNT 256
+#endif
+
+#if (REGISTER_COUNT < 10) || (REGISTER_COUNT > 256)
+#error "REGISTER_COUNT must be between 10 and 256"
+#endif
+
+
+/**
+ * Count of memory banks, and the size of the pages they're made from.
+ *
+ * Bank zero is the 64k of RAM which holds the program.  Every other bank
+ * is a further 64k address-space, for data, whose pages are allocated
+ * only when they are first written to.  Build with `-DSVM_BANK_COUNT=1`
+ * to leave only the program's RAM.
+ */
+#ifndef SVM_BANK_COUNT
+#define SVM_BANK_COUNT 256
+#endif
+
+#if (SVM_BANK_COUNT < 1) || (SVM_BANK_COUNT > 65536)
+#error "SVM_BANK_COUNT must be between 1 and 65536"
+#endif
+
+#define SVM_PAGE_SIZE 4096
+#define SVM_BANK_PAGES (0x10000 / SVM_PAGE_SIZE)
+
+
+/**
+ * The largest number of hash-maps a program may have open at once.
+ *
+ * Each is identified by a handle, from one to this count, and its table
+ * of handles grows as maps are created.
  */
-#define REGISTER_COUNT 10
+#ifndef SVM_MAP_COUNT
+#define SVM_MAP_COUNT 4096
+#endif
+
+#if (SVM_MAP_COUNT < 1) || (SVM_MAP_COUNT > 65536)
+#error "SVM_MAP_COUNT must be between 1 and 65536"
+#endif
+
+
+/**
+ * The largest number of entries the stack may hold.
+ *
+ * The stack starts empty, and grows as values are pushed onto it.
+ */
+#ifndef SVM_STACK_SIZE
+#define SVM_STACK_SIZE 1048576
+#endif
+
+#if (SVM_STACK_SIZE < 1) || (SVM_STACK_SIZE > 16777216)
+#error "SVM_STACK_SIZE must be between 1 and 16777216"
+#endif
+
+
+/**
+ * The number of compiled regular expressions a machine keeps.
+ *
+ * Patterns are cached in a direct-mapped table, so a program which uses
+ * many at once may find some compiled more than once.
+ */
+#ifndef SVM_REGEX_CACHE
+#define SVM_REGEX_CACHE 64
+#endif
+
+#if (SVM_REGEX_CACHE < 1) || (SVM_REGEX_CACHE > 65536) || (SVM_REGEX_CACHE & (SVM_REGEX_CACHE - 1))
+#error "SVM_REGEX_CACHE must be a power of two, no larger than 65536"
+#endif
+
+
+/**
+ * Size of the edge-coverage bitmap, in bytes.
+ *
+ * This matches the size of the map afl uses, so an afl shared-memory
+ * segment can be used directly.
+ */
+#define SVM_COVERAGE_SIZE 65536
 
 
 #ifndef _Bool
@@ -41,29 +130,95 @@
  * A single register.
  *
  * Our registers contain a simple union which allows them to store either
- * a string or an integer.
+ * a string or an integer, in a single 64-bit word.
+ *
+ * Integers are 64-bits wide, and all arithmetic upon them wraps around
+ * modulo 2^64.  That leaves no spare bits within the word to record its
+ * type, so the type of each register is held in a separate array of
+ * bytes, alongside the values.  Sixteen registers then fit within two
+ * cache-lines, rather than four, and testing a type is a single byte
+ * comparison.
+ *
+ * The registers should only be accessed via the macros below.
  *
  */
-typedef struct registers {
-    union {
-        unsigned int integer;
-        char *string;
-    } content;
-    enum { INTEGER, STRING } type;
+typedef union registers {
+    uint64_t integer;
+    char *string;
 } reg_t;
 
 
+/**
+ * The types a register may hold.
+ */
+enum register_types { INTEGER, STRING };
+
+
+/**
+ * Test the type of the given register.
+ */
+#define REGISTER_IS_STRING(svm, r)  ((svm)->types[r] == STRING)
+#define REGISTER_IS_INTEGER(svm, r) ((svm)->types[r] == INTEGER)
+
+
+/**
+ * The content of the given register, which must be of the right type.
+ */
+#define REGISTER_INTEGER(svm, r)    ((svm)->registers[r].integer)
+#define REGISTER_STRING(svm, r)     ((svm)->registers[r].string)
+
+
+/**
+ * Free any string the given register holds, leaving it holding zero.
+ */
+#define REGISTER_RELEASE(svm, r) do {                                   \
+        if (REGISTER_IS_STRING(svm, r) && REGISTER_STRING(svm, r))     \
+            free(REGISTER_STRING(svm, r));                             \
+        (svm)->types[r] = INTEGER;                                     \
+        REGISTER_INTEGER(svm, r) = 0;                                  \
+    } while (0)
+
+
+/**
+ * Store an integer, or a string which the register will then own, in the
+ * given register - freeing any string it held before.
+ *
+ * The value is evaluated before the register is released, so it may be
+ * derived from the register's current content.
+ */
+#define REGISTER_SET_INTEGER(svm, r, value) do {                        \
+        uint64_t register_value = (value);                              \
+        REGISTER_RELEASE(svm, r);                                       \
+        REGISTER_INTEGER(svm, r) = register_value;                      \
+    } while (0)
+
+#define REGISTER_SET_STRING(svm, r, value) do {                         \
+        char *register_value = (value);                                 \
+        REGISTER_RELEASE(svm, r);                                       \
+        (svm)->types[r] = STRING;                                       \
+        REGISTER_STRING(svm, r) = register_value;                       \
+    } while (0)
+
+
 
 /**
  * Flags.
  *
  * The various mathematical operations (such as add/sub/xor) will set the
- * Z flag to be true if their result is zero.
+ * Z flag to be true if their result is zero, and the S flag if it is
+ * negative when treated as signed.  Addition and subtraction also set
+ * the C flag on an unsigned carry, or borrow, and the O flag on signed
+ * overflow.
  *
- * This flag can then be used for the JMP_Z and JUMP_NZ instructions.
+ * Comparisons set the flags as if their second operand was subtracted
+ * from the first, so that the conditional jumps can test for both signed
+ * and unsigned ordering.
  */
 typedef struct flags {
     _Bool z;
+    _Bool c;
+    _Bool s;
+    _Bool o;
 } flag_t;
 
 
@@ -89,25 +244,43 @@ typedef void opcode_implementation(struct svm *in);
  */
 typedef struct svm {
     /**
-     * The registers that this virtual machine possesses
+     * The state every instruction touches comes first, followed by the
+     * registers, so the instruction-pointer, flags, and the low-numbered
+     * registers - which programs use the most - share the first
+     * cache-lines of the structure.
      */
-    reg_t registers[REGISTER_COUNT];
 
     /**
-     * The flags the CPU contains.
+     * The instruction-pointer.
      */
-    flag_t flags;
+    unsigned int ip;
 
     /**
-     * The instruction-pointer.
+     * The flags the CPU contains.
      */
-    unsigned int ip;
+    flag_t flags;
 
     /**
      * The code loaded in the machines RAM, and size of same.
+     *
+     * If the RAM was mapped by `svm_new_from_fd` it must be unmapped,
+     * rather than freed.
      */
     unsigned char *code;
     unsigned int size;
+    _Bool code_mapped;
+
+    /**
+     * The bank which loads and stores address - see SVM_BANK_COUNT.
+     */
+    unsigned int bank;
+
+    /**
+     * The registers that this virtual machine possesses, and the type of
+     * each - see `reg_t`.
+     */
+    reg_t registers[REGISTER_COUNT];
+    unsigned char types[REGISTER_COUNT];
 
     /**
      * The user may define a custom error-handler for when
@@ -126,31 +299,132 @@ typedef struct svm {
     opcode_implementation *opcodes[256];
 
     /**
-     * This is the stack for the virtual machine.  There are
-     * only a small number of entries permitted.
+     * This is the stack for the virtual machine, which holds values of
+     * either type, as the registers do, and the number of entries it
+     * has room for - see SVM_STACK_SIZE.
+     *
+     * Entry N is held at index N, so index zero is never used.  Strings
+     * on the stack are owned by it.
      */
-    int stack[1024];
+    reg_t *stack;
+    unsigned char *stack_types;
+    unsigned int stack_slots;
 
     /**
      * The stack pointer which starts from zero and grows upwards.
      */
     int SP;
 
+    /**
+     * The frame pointer, which is the entry ENTER saved the previous
+     * frame pointer in, or zero outside of any frame.
+     */
+    int FP;
+
     /**
      * State - Shouldn't really be here.
      */
     _Bool running;
 
+    /**
+     * Optional edge-coverage bitmap.
+     *
+     * If this is non-NULL then every taken jump, call and return will
+     * increment the entry for the (source, destination) edge.
+     */
+    unsigned char *coverage;
+    _Bool coverage_owned;
+
+    /**
+     * Optional execution profile.
+     *
+     * If this is non-NULL it holds a counter for each address, which is
+     * incremented every time an instruction at that address is executed.
+     */
+    unsigned int *profile;
+
+    /**
+     * The pages of the banks above zero, or NULL if none have been
+     * written to.
+     *
+     * Page N of bank B is entry ((B - 1) * SVM_BANK_PAGES) + N, and
+     * pages which have never been written to are NULL, reading as zero.
+     */
+    unsigned char **pages;
+
+    /**
+     * The hash-maps the program has created, where the map with handle
+     * N is entry N - 1, and the number of entries - see SVM_MAP_COUNT.
+     *
+     * Entries for maps which have been freed are NULL.
+     */
+    struct svm_map **maps;
+    unsigned int map_slots;
+
+    /**
+     * The patterns used by MATCH instructions, compiled, or NULL if
+     * none have been - see SVM_REGEX_CACHE.
+     *
+     * These aren't visible to the program, so they are kept when the
+     * machine is reset.
+     */
+    struct svm_regex **regexes;
+
+    /**
+     * The native functions the host has registered, indexed by their
+     * id, or NULL if none have been - see `svm_register_native`.
+     *
+     * These belong to the host, so they are kept when the machine is
+     * reset.
+     */
+    struct svm_native *natives;
+
+    /**
+     * The descriptions of custom opcodes the host has installed, indexed
+     * by opcode, or NULL if none have been - see `simple-vm-extension.h`.
+     *
+     * Like the natives these are kept when the machine is reset.
+     */
+    const struct svm_extension **extensions;
+
 } svm_t;
 
 
 
 /**
  * Allocate a new virtual machine instance.
+ *
+ * The code may be either raw bytecode, or an object-file as described in
+ * `simple-vm-object.h`.  NULL is returned if it cannot be loaded.
  */
 svm_t *svm_new(unsigned char *code, unsigned int size);
 
 
+/**
+ * Allocate a new virtual machine instance, mapping the program from the
+ * given file-descriptor rather than copying it.
+ *
+ * Returns NULL if the descriptor doesn't refer to a regular file, such
+ * as a pipe, or the program cannot be loaded.  The descriptor may be
+ * closed once this returns.
+ */
+svm_t *svm_new_from_fd(int fd);
+
+
+/**
+ * Reset an existing virtual machine instance, loading the given code.
+ *
+ * Registers, flags, the stack and RAM are all restored to the state
+ * `svm_new` would have given them, without re-allocating anything.
+ * This allows a single instance to be reused for many programs, which
+ * is what the persistent fuzzer does.
+ *
+ * Returns false if the code is too large to fit in RAM, or is an invalid
+ * object-file, in which case the machine is left untouched.
+ */
+_Bool svm_reset(svm_t * cpup, unsigned char *code, unsigned int size);
+
+
 /**
  * Configure a dedicated error-handler.
  *
@@ -179,6 +453,55 @@ void svm_default_error_handler(svm_t * cpup, char *msg);
 void svm_dump_registers(svm_t * cpup);
 
 
+/**
+ * Enable edge-coverage recording.
+ *
+ * If `bitmap` is NULL a private bitmap is allocated, otherwise the given
+ * memory - which must be SVM_COVERAGE_SIZE bytes, for example an afl
+ * shared-memory segment - is updated.
+ */
+_Bool svm_coverage_enable(svm_t * cpup, unsigned char *bitmap);
+
+
+/**
+ * Return the edge-coverage bitmap, or NULL if coverage is disabled.
+ */
+unsigned char *svm_coverage_bitmap(svm_t * cpup);
+
+
+/**
+ * Return the number of distinct edges which have been recorded.
+ */
+unsigned int svm_coverage_edges(svm_t * cpup);
+
+
+/**
+ * Clear the edge-coverage bitmap.
+ */
+void svm_coverage_clear(svm_t * cpup);
+
+
+/**
+ * Enable execution profiling, which counts how many times the instruction
+ * at each address is executed.
+ */
+_Bool svm_profile_enable(svm_t * cpup);
+
+
+/**
+ * Return the execution counts, indexed by address, or NULL if profiling
+ * is disabled.
+ */
+unsigned int *svm_profile_counts(svm_t * cpup);
+
+
+/**
+ * Write the non-zero execution counts to the given file, one per line, in
+ * the form "ADDRESS COUNT" - which the compiler's --profile option reads.
+ */
+_Bool svm_profile_write(svm_t * cpup, const char *filename);
+
+
 /**
  * Delete a virtual machine.
  */